@@ -0,0 +1,82 @@
+#ifndef _ACCELERATION_SOLVER_HPP_
+#define _ACCELERATION_SOLVER_HPP_
+
+#include "FreeStreamSolver.hpp"
+#include <thrust/for_each.h>
+#include <thrust/iterator/counting_iterator.h>
+#include <cassert>
+
+namespace quakins {
+namespace fbm {
+
+/**
+ *  df/dt + a(x) df/dv = 0 along velocity axis vdim (dim/2, ..., dim-1),
+ *  in place, in the layout of the CoordinateSystem: the same line sweep
+ *  as FreeStreamSolver, only the line now runs along the strided velocity
+ *  axis and its shift a*dt/dv belongs to the spatial point of the line.
+ *  f vanishes beyond the velocity grid. |a|*dt/dv must not exceed 1.
+ */
+template <typename val_type, std::size_t dim, std::size_t vdim>
+struct AccelerationSolver {
+
+	static_assert(vdim>=dim/2 && vdim<dim, "vdim is a velocity axis");
+
+	std::size_t nv, nBd, nTot, n_space;
+	std::size_t v_stride; // of the velocity axis in memory
+	val_type dt, dv;
+
+	AccelerationSolver(const CoordinateSystem<val_type,dim>& coord,
+										 val_type dt) : dt(dt) {
+		nv   = coord.nz[vdim];
+		nBd  = coord.nBd[vdim];
+		dv   = coord.dz[vdim];
+		nTot = thrust::reduce(coord.nzTot.begin(), coord.nzTot.end(),1,
+													thrust::multiplies<std::size_t>());
+		n_space = thrust::reduce(coord.nzTot.begin(), coord.nzTot.begin()+dim/2,
+													1, thrust::multiplies<std::size_t>());
+		v_stride = thrust::reduce(coord.nzTot.begin(), coord.nzTot.begin()+vdim,
+													1, thrust::multiplies<std::size_t>());
+		assert(nv>=2);
+	}
+
+	// a holds the acceleration of every spatial point, ghosts included
+	template <typename itor_type, typename a_itor_type>
+	void operator()(itor_type itor_begin, a_itor_type a_begin) {
+
+		// a single "velocity row", the shift is per line
+		LineBoundary<val_type> lb{BoundaryType::dirichlet, 0, nv, nBd,
+															v_stride, v_stride, 1, nullptr};
+		val_type shift = dt/dv;
+		std::size_t n_space = this->n_space;
+
+		thrust::for_each(thrust::make_counting_iterator<std::size_t>(0),
+										thrust::make_counting_iterator(nTot/lb.n_line()),
+		[=](std::size_t line) {
+			std::size_t idx = lb.line_begin(line);
+			val_type a = a_begin[idx%n_space]*shift;
+			FreeStreamSolver<val_type,dim,0>::sweep_line(itor_begin,idx,lb,a,false);
+		});
+	}
+
+};
+
+// the acceleration (charge_over_mass)*E = -(charge_over_mass) dphi/dx
+// of the n cells of a 1D potential, by central differences; the ghosts
+// of pot must be filled, those of a are set to 0
+template <typename pot_itor_type, typename a_itor_type, typename val_type>
+void acceleration_from_potential(pot_itor_type pot_begin, a_itor_type a_begin,
+																 std::size_t n, std::size_t nBd, val_type h,
+																 val_type charge_over_mass) {
+
+	thrust::for_each(thrust::make_counting_iterator<std::size_t>(0),
+									thrust::make_counting_iterator(n+2*nBd),
+	[=](std::size_t i) {
+		a_begin[i] = i<nBd || i>=n+nBd? val_type(0) :
+			-charge_over_mass*(pot_begin[i+1]-pot_begin[i-1])/(2*h);
+	});
+}
+
+} // namespace fbm
+} // namespace quakins
+
+#endif /* _ACCELERATION_SOLVER_HPP_ */
@@ -0,0 +1,140 @@
+#ifndef _BACKEND_HPP_
+#define _BACKEND_HPP_
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <iostream>
+#include <thrust/device_vector.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/**
+ *  The calls that differ between the device build (nvc++, CUDA device
+ *  system, cuFFT) and the host builds (-DQUAKINS_HOST with thrust's OMP,
+ *  TBB or CPP device system, FFTW). Everything else is written against
+ *  thrust and runs on either; "device" memory is host memory there and
+ *  the thrust algorithms use all the threads of the node.
+ */
+namespace quakins {
+namespace backend {
+
+#ifdef QUAKINS_HOST
+inline constexpr bool on_device = false;
+#else
+inline constexpr bool on_device = true;
+#endif
+
+inline std::string name() {
+#ifndef QUAKINS_HOST
+	return "cuda";
+#elif THRUST_DEVICE_SYSTEM==THRUST_DEVICE_SYSTEM_OMP
+	return "omp";
+#elif THRUST_DEVICE_SYSTEM==THRUST_DEVICE_SYSTEM_TBB
+	return "tbb";
+#else
+	return "cpp";
+#endif
+}
+
+// the GPU named by QUAKINS_DEVICE, else fallback; on the host the
+// number of threads, as OMP_NUM_THREADS says. false if there is no such
+// GPU
+inline bool select_device(int fallback = 0) {
+#ifdef QUAKINS_HOST
+	(void)fallback;
+#ifdef _OPENMP
+	std::cout << name() << " backend, " << omp_get_max_threads()
+						<< " threads" << std::endl;
+#endif
+#else
+	int device = fallback;
+	if (auto env = std::getenv("QUAKINS_DEVICE")) device = std::atoi(env);
+	cudaError_t err = cudaSetDevice(device);
+	if (err!=cudaSuccess) {
+		std::cerr << "cannot select GPU " << device << ": " 
+							<< cudaGetErrorString(err) << std::endl;
+		return false;
+	}
+#endif
+	return true;
+}
+
+// rank of n_rank on one node: the GPUs from QUAKINS_DEVICE (else 0) on,
+// round robin; on the host the rank's share of the threads. false if 
+// there is no GPU to take
+inline bool select_rank_device(int rank, int n_rank) {
+#ifdef QUAKINS_HOST
+	(void)rank;
+#ifdef _OPENMP
+	omp_set_num_threads(std::max(1,omp_get_max_threads()/n_rank));
+#else
+	(void)n_rank;
+#endif
+#else
+	(void)n_rank;
+	int base = 0, count = 0;
+	if (auto env = std::getenv("QUAKINS_DEVICE")) base = std::atoi(env);
+	cudaError_t err = cudaGetDeviceCount(&count);
+	if (err==cudaSuccess && count==0) err = cudaErrorNoDevice;
+	if (err==cudaSuccess) err = cudaSetDevice((base+rank)%count);
+	if (err!=cudaSuccess) {
+		std::cerr << "rank " << rank << " cannot select a GPU: " 
+							<< cudaGetErrorString(err) << std::endl;
+		return false;
+	}
+#endif
+	return true;
+}
+
+// the device heap, stack and printf buffer, for kernels that need them
+inline void set_device_limits(std::size_t bytes) {
+#ifndef QUAKINS_HOST
+	cudaDeviceSetLimit(cudaLimitMallocHeapSize, bytes);
+	cudaDeviceSetLimit(cudaLimitStackSize, bytes);
+	cudaDeviceSetLimit(cudaLimitPrintfFifoSize, bytes);
+#else
+	(void)bytes;
+#endif
+}
+
+// waits for the device work issued so far
+inline void synchronize() {
+#ifndef QUAKINS_HOST
+	cudaDeviceSynchronize();
+#endif
+}
+
+// host memory the device copies to and from fastest
+inline void* allocate_pinned(std::size_t bytes) {
+#ifdef QUAKINS_HOST
+	return ::operator new(bytes);
+#else
+	void* ptr; cudaMallocHost(&ptr,bytes);
+	return ptr;
+#endif
+}
+
+inline void free_pinned(void* ptr) {
+#ifdef QUAKINS_HOST
+	::operator delete(ptr);
+#else
+	cudaFreeHost(ptr);
+#endif
+}
+
+// bytes from host memory into device memory
+inline void copy_to_device(void* dst, const void* src, std::size_t bytes) {
+#ifdef QUAKINS_HOST
+	std::memcpy(dst,src,bytes);
+#else
+	cudaMemcpy(dst,src,bytes,cudaMemcpyHostToDevice);
+#endif
+}
+
+} // namespace backend
+} // namespace quakins
+
+#endif /* _BACKEND_HPP_ */
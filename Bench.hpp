@@ -0,0 +1,74 @@
+#ifndef _BENCH_HPP_
+#define _BENCH_HPP_
+
+#include "Backend.hpp"
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+#include <thrust/copy.h>
+#include <thrust/device_vector.h>
+
+/**
+ *  What the bench_* programs share: the time of a call after a warm-up,
+ *  with the backend synchronized around it, and the table of kernels
+ *  that measure() prints and collects for a CSV file. Builds for the
+ *  device and the host backends alike.
+ */
+namespace quakins {
+namespace bench {
+
+inline int n_rep = 20;
+
+// mean time of n_rep calls of func, in ms
+template <typename Func>
+double time_ms(Func func, int n_rep) {
+	func(); // warm up
+	backend::synchronize();
+	auto t1 = std::chrono::steady_clock::now();
+	for (int i=0; i<n_rep; i++) func();
+	backend::synchronize();
+	auto t2 = std::chrono::steady_clock::now();
+	return std::chrono::duration<double,std::milli>(t2-t1).count()/n_rep;
+}
+
+struct Result {
+	std::string kernel, shape;
+	double ms, GBps, of_copy;
+};
+
+inline std::vector<Result> results;
+
+// a device-to-device copy of n values, read and written
+template <typename val_type = float>
+double copy_GBps(std::size_t n) {
+	static std::map<std::size_t,double> baseline;
+	auto& GBps = baseline[n];
+	if (GBps==0) {
+		thrust::device_vector<val_type> a(n), b(n);
+		double ms = time_ms([&]{ thrust::copy(a.begin(),a.end(),b.begin()); },n_rep);
+		GBps = 2*n*sizeof(val_type)/ms/1e6;
+	}
+	return GBps;
+}
+
+// bytes: what one call has to move at least, n: the values of f
+template <typename val_type = float, typename Func>
+void measure(std::string kernel, std::string shape, std::size_t n,
+						 std::size_t bytes, Func func) {
+	double ms = time_ms(func,n_rep);
+	double GBps = bytes/ms/1e6;
+	results.push_back({kernel,shape,ms,GBps,100*GBps/copy_GBps<val_type>(n)});
+	auto& r = results.back();
+	std::cout << std::left << std::setw(28) << r.kernel << std::setw(22) << r.shape
+						<< std::right << std::setw(10) << r.ms << " ms"
+						<< std::setw(12) << r.GBps << " GB/s"
+						<< std::setw(10) << r.of_copy << " %" << std::endl;
+}
+
+} // namespace bench
+} // namespace quakins
+
+#endif /* _BENCH_HPP_ */
@@ -0,0 +1,142 @@
+#ifndef _BOUNDARY_CONDITION_HPP_
+#define _BOUNDARY_CONDITION_HPP_
+
+#include <thrust/host_vector.h>
+#include <thrust/device_vector.h>
+#include <thrust/for_each.h>
+#include <thrust/iterator/counting_iterator.h>
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cmath>
+
+namespace quakins {
+
+// external: the ghosts are filled by someone else, a halo exchange with
+// the neighbouring subdomains, and read as they are
+enum class BoundaryType { periodic, outflow, reflecting, dirichlet, external };
+
+template <typename val_type>
+struct Boundary {
+	BoundaryType type = BoundaryType::periodic;
+	val_type value = 0; // the ghost value of a dirichlet boundary
+};
+
+// the velocity row that a reflecting wall maps row i to, i.e. the
+// grid point closest to -v[i]
+template <typename val_type>
+thrust::host_vector<std::size_t>
+mirror_rows(const thrust::host_vector<val_type>& v) {
+	thrust::host_vector<std::size_t> mirror(v.size());
+	for (std::size_t i=0; i<v.size(); i++) {
+		std::size_t j_min = 0;
+		for (std::size_t j=1; j<v.size(); j++)
+			if (std::abs(v[j]+v[i]) < std::abs(v[j_min]+v[i])) j_min = j;
+		mirror[i] = j_min;
+	}
+	return mirror;
+}
+
+/**
+ *  Ghost zones of the lines along one axis: a line has nBd ghosts, nx
+ *  cells and nBd ghosts again, x_stride apart in memory, and belongs to
+ *  the velocity row (idx/v_stride)%nv. Trivially copyable into kernels.
+ */
+template <typename val_type>
+struct LineBoundary {
+
+	BoundaryType type;
+	val_type value;
+	std::size_t nx, nBd, x_stride, v_stride, nv;
+	const std::size_t *mirror;
+
+	__host__ __device__
+	std::size_t n_line() const { return nx+2*nBd; }
+
+	// first cell of line l
+	__host__ __device__
+	std::size_t line_begin(std::size_t l) const {
+		return (l/x_stride)*x_stride*n_line() + l%x_stride;
+	}
+
+	// value at position p of the line starting at idx, where p may lie
+	// anywhere in the ghost zones; the ghosts themselves are only read
+	// if they are external
+	template <typename itor_type>
+	__host__ __device__
+	val_type read(itor_type f, std::size_t idx, std::ptrdiff_t p) const {
+		std::ptrdiff_t lo = nBd, hi = nBd+nx;
+		if (p>=lo && p<hi) return f[idx+p*x_stride];
+
+		switch (type) {
+		case BoundaryType::periodic:
+			return f[idx+(p<lo? p+nx : p-nx)*x_stride];
+		case BoundaryType::outflow:
+			return f[idx+(p<lo? lo : hi-1)*x_stride];
+		case BoundaryType::reflecting: {
+			std::size_t row = (idx/v_stride)%nv;
+			std::size_t image = idx + mirror[row]*v_stride - row*v_stride;
+			return f[image+(p<lo? 2*lo-1-p : 2*hi-1-p)*x_stride];
+		}
+		case BoundaryType::external:
+			return f[idx+p*x_stride];
+		default:
+			return value;
+		}
+	}
+
+};
+
+// fill every ghost zone of the n_tot elements in one pass
+template <typename itor_type, typename val_type>
+void fill_ghosts(itor_type itor_begin, std::size_t n_tot,
+								 LineBoundary<val_type> bd) {
+
+	std::size_t n_ghost = 2*bd.nBd;
+	thrust::for_each(thrust::make_counting_iterator<std::size_t>(0),
+									thrust::make_counting_iterator(n_tot/bd.n_line()*n_ghost),
+	[=](std::size_t i) {
+		std::size_t idx = bd.line_begin(i/n_ghost), g = i%n_ghost;
+		std::size_t p = g<bd.nBd? g : g+bd.nx;
+		itor_begin[idx+p*bd.x_stride] = bd.read(itor_begin,idx,p);
+	});
+
+}
+
+// periodic ghosts of n_batch padded fields, n cells and nBd ghosts on
+// both ends of every axis, dimension 0 fastest; every ghost, corners 
+// included, takes the value of its periodic image inside
+template <std::size_t rank, typename itor_type>
+void fill_periodic_ghosts(itor_type itor_begin, std::size_t n_batch,
+													std::array<std::size_t,rank> n,
+													std::array<std::size_t,rank> nBd) {
+
+	std::size_t n_field = 1;
+	for (std::size_t i=0; i<rank; i++) {
+		assert(nBd[i]<=n[i]); // the images of the ghosts are inside cells
+		n_field *= n[i]+2*nBd[i];
+	}
+
+	thrust::for_each(thrust::make_counting_iterator<std::size_t>(0),
+									thrust::make_counting_iterator(n_batch*n_field),
+	[=](std::size_t idx) {
+		std::size_t rest = idx%n_field, image = idx-rest, stride = 1;
+		bool ghost = false;
+		for (std::size_t i=0; i<rank; i++) {
+			std::size_t nTot = n[i]+2*nBd[i], j = rest%nTot;
+			rest /= nTot;
+			if (j<nBd[i] || j>=nBd[i]+n[i]) {
+				ghost = true;
+				j = nBd[i] + (j+n[i]-nBd[i])%n[i];
+			}
+			image += j*stride;
+			stride *= nTot;
+		}
+		if (ghost) itor_begin[idx] = itor_begin[image];
+	});
+
+}
+
+} // namespace quakins
+
+#endif /* _BOUNDARY_CONDITION_HPP_ */
@@ -0,0 +1,65 @@
+#ifndef _BUFFER_POOL_HPP_
+#define _BUFFER_POOL_HPP_
+
+#include <thrust/device_vector.h>
+#include <vector>
+#include <memory>
+#include <cstddef>
+
+namespace quakins {
+
+/**
+ *  Scratch buffers that outlive a call: acquire() hands out a buffer of
+ *  at least n elements, which goes back to the pool when the lease dies,
+ *  so the steps of a time loop reuse the same memory instead of
+ *  allocating it every time.
+ */
+template <typename val_type, template<typename...> typename Container>
+class BufferPool {
+
+	using buffer_type = Container<val_type>;
+	std::vector<std::unique_ptr<buffer_type>> free_list;
+
+public:
+	class Lease {
+		BufferPool* pool;
+		std::unique_ptr<buffer_type> buf;
+	public:
+		Lease(BufferPool* pool, std::unique_ptr<buffer_type> buf)
+			: pool(pool), buf(std::move(buf)) {}
+		Lease(Lease&&) = default;
+		~Lease() { if (buf) pool->free_list.push_back(std::move(buf)); }
+
+		buffer_type& operator*() { return *buf; }
+		buffer_type* operator->() { return buf.get(); }
+		val_type* data() { return thrust::raw_pointer_cast(buf->data()); }
+	};
+
+	Lease acquire(std::size_t n) {
+		// the smallest free buffer that is large enough, else grow one
+		auto best = free_list.end();
+		for (auto it=free_list.begin(); it!=free_list.end(); it++)
+			if ((*it)->size()>=n && (best==free_list.end() 
+															 || (*it)->size()<(*best)->size())) best = it;
+		std::unique_ptr<buffer_type> buf;
+		if (best==free_list.end() && !free_list.empty()) best = free_list.begin();
+		if (best!=free_list.end()) {
+			buf = std::move(*best);
+			free_list.erase(best);
+		} else buf = std::make_unique<buffer_type>();
+		if (buf->size()<n) buf->resize(n);
+		return Lease(this,std::move(buf));
+	}
+
+	// bytes held by the free buffers
+	std::size_t bytes() const {
+		std::size_t b = 0;
+		for (auto& buf : free_list) b += buf->size()*sizeof(val_type);
+		return b;
+	}
+
+};
+
+} // namespace quakins
+
+#endif /* _BUFFER_POOL_HPP_ */
@@ -0,0 +1,141 @@
+#ifndef _CHECKPOINT_HPP_
+#define _CHECKPOINT_HPP_
+
+#include "Snapshot.hpp"
+#include <thrust/device_vector.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <map>
+#include <string>
+#include <sstream>
+#include <iostream>
+
+namespace quakins {
+
+/**
+ *  Checkpoint files: the solver parameters, then one snapshot record
+ *  (Snapshot.hpp) of the distribution function, which carries the step,
+ *  the time, the grid and the layout order of f.
+ *
+ *    char[8]  "QKCKPT\0\0"
+ *    u32      version, number of parameters
+ *    per parameter: u32 length of the name, the name, f64 value
+ *    the snapshot record of f
+ *
+ *  save() goes through a SnapshotWriter, so the run only waits for the
+ *  copy of f into staging memory, and the previous checkpoint is kept
+ *  until the new one is complete. load() maps the file and copies the
+ *  values straight into f.
+ */
+struct Checkpoint {
+
+	static constexpr char magic[8] = {'Q','K','C','K','P','T',0,0};
+	static constexpr std::uint32_t version = 1;
+
+	std::map<std::string,double> params;
+	SnapshotHeader header;
+
+	std::uint64_t step() const { return header.step; }
+	double time() const { return header.time; }
+	// the CoordinateSystem axes of f, fastest first
+	std::vector<std::size_t> order() const {
+		std::vector<std::size_t> o;
+		for (auto& axis : header.axes) o.push_back(axis.id);
+		return o;
+	}
+
+	template <typename itor_type, typename val_type, std::size_t dim>
+	static void save(SnapshotWriter& writer, std::string path,
+									 itor_type f_begin,
+									 const CoordinateSystem<val_type,dim>& coord,
+									 const std::vector<std::size_t>& order,
+									 std::size_t step, double time,
+									 const std::map<std::string,double>& params = {}) {
+
+		std::ostringstream os;
+		auto put = [&](auto v) { os.write(reinterpret_cast<const char*>(&v),sizeof(v)); };
+		os.write(magic,8);
+		put(version); put(static_cast<std::uint32_t>(params.size()));
+		for (auto& [name,value] : params) {
+			put(static_cast<std::uint32_t>(name.size()));
+			os.write(name.data(),name.size());
+			put(value);
+		}
+		writer.write_file<val_type>(path,os.str(),
+			SnapshotHeader::make("f",coord,order,step,time),f_begin);
+	}
+
+	// reads the checkpoint at path into f, which must have the grid of
+	// coord and be laid out in order; false, with f untouched, if the file
+	// is missing or does not match
+	template <typename itor_type, typename val_type, std::size_t dim>
+	bool load(std::string path, itor_type f_begin,
+						const CoordinateSystem<val_type,dim>& coord,
+						const std::vector<std::size_t>& order) {
+
+		// the parameters and the header are small, read them as a stream
+		std::ifstream is(path,std::ios::in|std::ios::binary);
+		auto get = [&](auto& v) { is.read(reinterpret_cast<char*>(&v),sizeof(v)); };
+		char m[8]; std::uint32_t ver, n_param;
+		if (!is.read(m,8) || std::memcmp(m,magic,8)!=0) {
+			std::cerr << path << " is not a checkpoint" << std::endl;
+			return false;
+		}
+		get(ver); get(n_param);
+		params.clear();
+		for (std::uint32_t i=0; i<n_param && is; i++) {
+			std::uint32_t len; double value;
+			get(len); std::string name(len,' ');
+			is.read(name.data(),len); get(value);
+			params[name] = value;
+		}
+		if (ver!=version || !header.read(is)) {
+			std::cerr << path << " is damaged" << std::endl;
+			return false;
+		}
+		std::size_t offset = is.tellg();
+
+		auto expected = SnapshotHeader::make("f",coord,order,0,0);
+		bool match = header.val_size==sizeof(val_type)
+								&& header.axes.size()==expected.axes.size();
+		for (std::size_t i=0; match && i<header.axes.size(); i++)
+			match = header.axes[i].id==expected.axes[i].id
+						&& header.axes[i].nz==expected.axes[i].nz
+						&& header.axes[i].nBd==expected.axes[i].nBd;
+		if (!match) {
+			std::cerr << path << " does not match the grid or layout" << std::endl;
+			return false;
+		}
+
+		// the values, mapped and copied without going through a stream
+		int fd = open(path.c_str(),O_RDONLY);
+		struct stat st;
+		std::size_t bytes = header.n_value()*sizeof(val_type);
+		if (fd<0 || fstat(fd,&st)!=0
+				|| static_cast<std::size_t>(st.st_size)<offset+bytes) {
+			std::cerr << path << " is truncated" << std::endl;
+			if (fd>=0) close(fd);
+			return false;
+		}
+		void* map = mmap(nullptr,st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+		close(fd);
+		if (map==MAP_FAILED) {
+			std::cerr << "cannot map " << path << std::endl;
+			return false;
+		}
+		madvise(map,st.st_size,MADV_SEQUENTIAL);
+		// as bytes, the values need not be aligned in the file
+		auto values = static_cast<const char*>(map)+offset;
+		backend::copy_to_device(thrust::raw_pointer_cast(&f_begin[0]),
+														values,bytes);
+		munmap(map,st.st_size);
+		return true;
+	}
+
+};
+
+} // namespace quakins
+
+#endif /* _CHECKPOINT_HPP_ */
@@ -41,13 +41,10 @@ struct CoordinateSystem {
 	const std::array<val_type,dim>
 	operator[](std::size_t idx) const {
 		std::array<val_type,dim> z;
+		std::size_t dvd_num = 1;
 		for (std::size_t i=0; i<dim; i++) {
-
-			std::size_t dvd_num = thrust::reduce(nzTot.begin(),
-											nzTot.begin()+i, 1,
-												thrust::multiplies<std::size_t>());
-			std::size_t mod_num = dvd_num * nzTot[i];
-			z[i] = coord[i][(idx%mod_num)/dvd_num];
+			z[i] = coord[i][idx/dvd_num%nzTot[i]];
+			dvd_num *= nzTot[i];
 		}
 		return z;
 		
@@ -0,0 +1,279 @@
+#ifndef _DECOMPOSITION_HPP_
+#define _DECOMPOSITION_HPP_
+
+#include "Backend.hpp"
+#include "CoordinateSystem.hpp"
+#include "Transport.hpp"
+#include <thrust/host_vector.h>
+#include <thrust/device_vector.h>
+#include <thrust/fill.h>
+#include <thrust/for_each.h>
+#include <thrust/iterator/counting_iterator.h>
+#include <cassert>
+#include <thread>
+
+namespace quakins {
+
+/**
+ *  The part of phase space one rank holds when the outermost velocity
+ *  axis is split across the ranks. In the CoordinateSystem layout that
+ *  axis varies slowest, so a slab is one contiguous range of f, and the
+ *  rank's own CoordinateSystem describes it completely: FreeStreamSolver,
+ *  the reducers, snapshots and checkpoints take it as they take a full
+ *  grid. Advection along x needs nothing from the other ranks; densities
+ *  and other velocity moments are partial sums, to be allreduced.
+ *
+ *  The slabs start at even rows, so the Simpson-like weights of
+ *  velocity_weights() are those of the full axis.
+ */
+template <typename val_type, std::size_t dim>
+struct VelocitySlab {
+
+	static constexpr std::size_t axis = dim-1;
+
+	std::size_t lo, hi;       // rows of the full axis
+	std::size_t offset, nTot; // elements of f before the slab, in it
+	CoordinateSystem<val_type,dim> coord;
+
+	VelocitySlab(const CoordinateSystem<val_type,dim>& global,
+							 int rank, int size)
+	: lo(row(global,rank,size)), hi(row(global,rank+1,size)),
+		coord(local(global,lo,hi)) {
+
+		std::size_t stride = 1;
+		for (std::size_t i=0; i<axis; i++) stride *= global.nzTot[i];
+		offset = lo*stride; nTot = (hi-lo)*stride;
+	}
+
+	// first row of rank r, rows in pairs, the last rank takes an odd one
+	static std::size_t row(const CoordinateSystem<val_type,dim>& global,
+												 int r, int size) {
+		assert(global.nBd[axis]==0 && global.nz[axis]>=2*std::size_t(size));
+		return r==size? global.nz[axis] : 2*(global.nz[axis]/2*r/size);
+	}
+
+	// the grid of rows [lo,hi), with the coordinates of the full one
+	static CoordinateSystem<val_type,dim>
+	local(const CoordinateSystem<val_type,dim>& global,
+				std::size_t lo, std::size_t hi) {
+		auto nz = global.nz; auto range = global.range;
+		nz[axis] = hi-lo;
+		range[2*axis] = global.range[2*axis]+lo*global.dz[axis];
+		range[2*axis+1] = global.range[2*axis]+hi*global.dz[axis];
+		CoordinateSystem<val_type,dim> coord(nz,global.nBd,range);
+		coord.dz[axis] = global.dz[axis];
+		coord.coord[axis] = thrust::host_vector<val_type>(
+			global.coord[axis].begin()+lo,global.coord[axis].begin()+hi);
+		return coord;
+	}
+};
+
+// v becomes the sum of v over the ranks, through the host on the device
+// backend
+template <typename val_type>
+void allreduce(Transport& transport, thrust::device_vector<val_type>& v) {
+	if (transport.size()==1) return;
+	if constexpr (backend::on_device) {
+		thrust::host_vector<val_type> h = v;
+		transport.allreduce(h.data(),h.size());
+		v = h;
+	} else
+		transport.allreduce(thrust::raw_pointer_cast(v.data()),v.size());
+}
+
+/**
+ *  The part of the grid one rank holds when spatial axis `axis` (the 
+ *  outermost one by default) is split into consecutive ranges of cells,
+ *  periodic across the ranks. The local CoordinateSystem has the same
+ *  ghost widths; along the split axis its ghosts hold the neighbours' 
+ *  cells, filled by HaloExchange, so the solvers of that axis take 
+ *  BoundaryType::external there.
+ */
+template <typename val_type, std::size_t dim, std::size_t axis = dim/2-1>
+struct SpatialDomain {
+
+	static_assert(axis<dim/2);
+
+	int rank, size, left, right; // the neighbours, periodic
+	std::size_t lo, hi;          // cells of the full axis
+	CoordinateSystem<val_type,dim> coord;
+
+	SpatialDomain(const CoordinateSystem<val_type,dim>& global,
+								int rank, int size)
+	: rank(rank), size(size), left((rank+size-1)%size), right((rank+1)%size),
+		lo(global.nz[axis]*rank/size), hi(global.nz[axis]*(rank+1)/size),
+		coord(local(global,lo,hi)) {}
+
+	// the grid of cells [lo,hi) and their ghosts, with the coordinates of
+	// the full one
+	static CoordinateSystem<val_type,dim>
+	local(const CoordinateSystem<val_type,dim>& global,
+				std::size_t lo, std::size_t hi) {
+		auto nz = global.nz; auto range = global.range;
+		nz[axis] = hi-lo;
+		range[2*axis] = global.range[2*axis]+lo*global.dz[axis];
+		range[2*axis+1] = global.range[2*axis]+hi*global.dz[axis];
+		CoordinateSystem<val_type,dim> coord(nz,global.nBd,range);
+		coord.dz[axis] = global.dz[axis];
+		coord.coord[axis] = thrust::host_vector<val_type>(
+			global.coord[axis].begin()+lo,
+			global.coord[axis].begin()+hi+2*global.nBd[axis]);
+		return coord;
+	}
+
+	// a field on the spatial axes of the full grid, from the rank's part
+	// of it, on every rank: the other parts are zeros, so the allreduce
+	// adds nothing to them
+	template <typename itor_type>
+	void allgather(Transport& transport, itor_type local_begin,
+								 thrust::device_vector<val_type>& full,
+								 const CoordinateSystem<val_type,dim>& global) const {
+
+		std::size_t s = 1, n_local = 1, n_full = 1;
+		for (std::size_t i=0; i<dim/2; i++) {
+			if (i<axis) s *= global.nzTot[i];
+			n_local *= coord.nzTot[i]; n_full *= global.nzTot[i];
+		}
+		std::size_t nl = coord.nzTot[axis], ng = global.nzTot[axis];
+		std::size_t nBd = coord.nBd[axis], n = coord.nz[axis], off = lo;
+
+		full.resize(n_full);
+		thrust::fill(full.begin(),full.end(),val_type(0));
+		auto full_ptr = thrust::raw_pointer_cast(full.data());
+		thrust::for_each(thrust::make_counting_iterator<std::size_t>(0),
+										thrust::make_counting_iterator(n_local),
+		[=](std::size_t idx) {
+			std::size_t j = idx/s%nl; // along the axis, ghosts excluded
+			if (j<nBd || j>=nBd+n) return;
+			std::size_t outer = idx/(s*nl);
+			full_ptr[(outer*ng+j+off)*s+idx%s] = local_begin[idx];
+		});
+		allreduce(transport,full);
+	}
+
+	// the rank's part of a field on the full grid, ghosts included
+	template <typename itor_type>
+	void scatter(const thrust::device_vector<val_type>& full, itor_type local_begin,
+							 const CoordinateSystem<val_type,dim>& global) const {
+
+		std::size_t s = 1, n_local = 1;
+		for (std::size_t i=0; i<dim/2; i++) {
+			if (i<axis) s *= global.nzTot[i];
+			n_local *= coord.nzTot[i];
+		}
+		std::size_t nl = coord.nzTot[axis], ng = global.nzTot[axis], off = lo;
+		auto full_ptr = thrust::raw_pointer_cast(full.data());
+		thrust::for_each(thrust::make_counting_iterator<std::size_t>(0),
+										thrust::make_counting_iterator(n_local),
+		[=](std::size_t idx) {
+			std::size_t j = idx/s%nl, outer = idx/(s*nl);
+			local_begin[idx] = full_ptr[(outer*ng+j+off)*s+idx%s];
+		});
+	}
+};
+
+/**
+ *  The ghosts of a SpatialDomain along its split axis, from the cells of
+ *  the neighbouring ranks: the nBd layers next to either end are packed
+ *  into one contiguous buffer each, exchanged, and unpacked into the 
+ *  ghosts. start() packs and hands the exchange to a thread of its own,
+ *  finish() waits for it and unpacks, so the interior cells can be 
+ *  advected in between:
+ *
+ *    halo.start(f.begin());
+ *    solver.advect_interior(f.begin(),g.begin());
+ *    halo.finish(f.begin());
+ *    solver.advect_edges(f.begin(),g.begin());
+ *
+ *  Every rank does so together, the exchange is collective.
+ */
+template <typename val_type, std::size_t dim>
+class HaloExchange {
+
+	Transport& transport;
+	int left, right;
+	std::size_t s, nl, nBd, n, n_halo; // stride, line, ghosts, cells, halo
+	thrust::device_vector<val_type> send, recv;  // to/from left, then right
+	thrust::host_vector<val_type> h_send, h_recv; // staging on the device
+	std::thread exchanging;
+
+	val_type* host_ptr(thrust::device_vector<val_type>& d,
+										 thrust::host_vector<val_type>& h) {
+		if constexpr (backend::on_device) return h.data();
+		else return thrust::raw_pointer_cast(d.data());
+	}
+
+public:
+	template <std::size_t axis>
+	HaloExchange(Transport& transport, 
+							 const SpatialDomain<val_type,dim,axis>& domain)
+	: transport(transport), left(domain.left), right(domain.right) {
+		auto& coord = domain.coord;
+		std::size_t n_tot = 1; s = 1;
+		for (std::size_t i=0; i<dim; i++) {
+			n_tot *= coord.nzTot[i];
+			if (i<axis) s *= coord.nzTot[i];
+		}
+		nl = coord.nzTot[axis]; nBd = coord.nBd[axis]; n = coord.nz[axis];
+		assert(n>=nBd);
+		n_halo = n_tot/nl*nBd;
+		send.resize(2*n_halo); recv.resize(2*n_halo);
+		if constexpr (backend::on_device) {
+			h_send.resize(2*n_halo); h_recv.resize(2*n_halo);
+		}
+	}
+	HaloExchange(const HaloExchange&) = delete;
+	HaloExchange& operator=(const HaloExchange&) = delete;
+	~HaloExchange() { if (exchanging.joinable()) exchanging.join(); }
+
+	// values per ghost zone
+	std::size_t size() const { return n_halo; }
+
+	template <typename itor_type>
+	void start(itor_type f_begin) {
+
+		auto send_ptr = thrust::raw_pointer_cast(send.data());
+		auto s = this->s; auto nl = this->nl; auto nBd = this->nBd;
+		auto n = this->n; auto n_halo = this->n_halo;
+		// layer l of the first and of the last nBd cells
+		thrust::for_each(thrust::make_counting_iterator<std::size_t>(0),
+										thrust::make_counting_iterator(n_halo),
+		[=](std::size_t t) {
+			std::size_t l = t/s%nBd, base = t/(s*nBd)*s*nl + t%s;
+			send_ptr[t] = f_begin[base+(nBd+l)*s];
+			send_ptr[n_halo+t] = f_begin[base+(n+l)*s];
+		});
+		if constexpr (backend::on_device) h_send = send;
+
+		auto snd = host_ptr(send,h_send), rcv = host_ptr(recv,h_recv);
+		exchanging = std::thread([=,this] {
+			transport.exchange(left,right,snd,snd+n_halo,rcv,rcv+n_halo,n_halo);
+		});
+	}
+
+	template <typename itor_type>
+	void finish(itor_type f_begin) {
+
+		exchanging.join();
+		if constexpr (backend::on_device) recv = h_recv;
+
+		auto recv_ptr = thrust::raw_pointer_cast(recv.data());
+		auto s = this->s; auto nl = this->nl; auto nBd = this->nBd;
+		auto n = this->n; auto n_halo = this->n_halo;
+		thrust::for_each(thrust::make_counting_iterator<std::size_t>(0),
+										thrust::make_counting_iterator(n_halo),
+		[=](std::size_t t) {
+			std::size_t l = t/s%nBd, base = t/(s*nBd)*s*nl + t%s;
+			f_begin[base+l*s] = recv_ptr[t];
+			f_begin[base+(nBd+n+l)*s] = recv_ptr[n_halo+t];
+		});
+	}
+
+	// without anything to overlap
+	template <typename itor_type>
+	void operator()(itor_type f_begin) { start(f_begin); finish(f_begin); }
+};
+
+} // namespace quakins
+
+#endif /* _DECOMPOSITION_HPP_ */
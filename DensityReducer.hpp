@@ -11,6 +11,8 @@
 #include <thrust/device_vector.h>
 #include <thrust/reduce.h>
 #include <array>
+#include "Layout.hpp"
+#include "CoordinateSystem.hpp"
 
 #include <iostream>
 
@@ -57,6 +59,77 @@ struct DensityReducer {
 };
 
 
+// Quadrature weight of every velocity grid point of coord, the product 
+// of the per-axis weights of DensityReducer, in the order of the 
+// CoordinateSystem; the velocity ghost cells get no weight.
+template <typename val_type, std::size_t dim>
+thrust::host_vector<val_type> 
+velocity_weights(const CoordinateSystem<val_type,dim>& coord) {
+	
+	constexpr std::size_t vdim = dim/2;
+	thrust::host_vector<val_type> w(1,1);
+	for (std::size_t i=vdim; i<dim; i++) {
+		val_type C = coord.dz[i]/3.;
+		thrust::host_vector<val_type> w_new(w.size()*coord.nzTot[i]);
+		for (std::size_t j=0; j<coord.nzTot[i]; j++) {
+			bool ghost = j<coord.nBd[i] || j>=coord.nBd[i]+coord.nz[i];
+			val_type wj = ghost? 0 : (j-coord.nBd[i])%2==0? 2*C:4*C;
+			for (std::size_t k=0; k<w.size(); k++)
+				w_new[j*w.size()+k] = wj*w[k];
+		}
+		w = w_new;
+	}
+	return w;
+}
+
+
+// Integrates over all the velocity axes n_v... at once: every one of the
+// n_batch segments has the compile-time length n_v0*n_v1*..., so it is
+// summed directly, without keys and without intermediate densities.
+// The segments are contiguous if v_inner ({v...,x...} layout), otherwise 
+// interleaved with stride n_batch ({x...,v...}, the CoordinateSystem one).
+template<typename val_type, std::size_t n_batch, bool v_inner,
+				 std::size_t... n_v>
+struct FusedDensityReducer {
+
+	static constexpr std::size_t n_vdim = sizeof...(n_v);
+	static constexpr std::size_t n_seg = (n_v * ...);
+
+	std::array<val_type,n_vdim> coeff;
+
+	// {a0,b0,a1,b1,...}, the range of each velocity axis
+	FusedDensityReducer(std::array<val_type,2*n_vdim> range) {
+		constexpr std::size_t n[n_vdim] = {n_v...};
+		for (std::size_t i=0; i<n_vdim; i++)
+			coeff[i] = (range[2*i+1]-range[2*i])/3./static_cast<val_type>(n[i]);
+	}
+
+	// bytes read and written by one call
+	std::size_t bytes() const { 
+		return (n_seg+1)*n_batch*sizeof(val_type); 
+	}
+
+	template <typename in_itor_type, typename out_itor_type>
+	void operator()(in_itor_type f_begin, out_itor_type dens_begin) {
+
+		thrust::for_each(thrust::make_counting_iterator<std::size_t>(0),
+										thrust::make_counting_iterator(n_batch),
+		[=,C=coeff](std::size_t b) {
+			val_type sum = 0;
+			for (std::size_t s=0; s<n_seg; s++) {
+				auto idx_m = StaticLayout<n_v...>::idxS2M(s);
+				val_type w = 1;
+				for (std::size_t i=0; i<n_vdim; i++)
+					w *= idx_m[i]%2==0? 2*C[i]:4*C[i];
+				sum += w*f_begin[v_inner? b*n_seg+s : s*n_batch+b];
+			}
+			dens_begin[b] = sum;
+		});
+
+	}
+
+};
+
 
 } // namespace quakins
 
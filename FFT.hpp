@@ -0,0 +1,226 @@
+#ifndef _FFT_HPP_
+#define _FFT_HPP_
+
+#include <thrust/complex.h>
+#include <array>
+#include <vector>
+#include <cstddef>
+#include <type_traits>
+#include <algorithm>
+#include <mutex>
+
+// cuFFT by default, FFTW for CPU-only builds (-DQUAKINS_HOST together
+// with an OMP or CPP thrust device system and -lfftw3f -lfftw3)
+#ifdef QUAKINS_HOST
+#include <fftw3.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#else
+#include <cufft.h>
+#endif
+
+namespace quakins {
+
+#ifndef QUAKINS_HOST
+/**
+ *  The cuFFT work area of every plan of the process. The plans are made
+ *  without their own, a transform asks for one at least as large as its
+ *  plan needs and gets the single shared buffer, grown when needed. The 
+ *  transforms all go to the default stream, so they never run at the same
+ *  time. The memory is freed at exit, errors ignored as the context may 
+ *  be gone by then.
+ */
+class FFTWorkspace {
+
+	std::mutex mtx;
+	void* ptr = nullptr;
+	std::size_t size = 0;
+
+	FFTWorkspace() = default;
+	~FFTWorkspace() { if (ptr) cudaFree(ptr); }
+
+public:
+	FFTWorkspace(const FFTWorkspace&) = delete;
+	FFTWorkspace& operator=(const FFTWorkspace&) = delete;
+
+	static FFTWorkspace& instance() {
+		static FFTWorkspace workspace;
+		return workspace;
+	}
+
+	void* get(std::size_t bytes) {
+		std::lock_guard<std::mutex> lock(mtx);
+		if (bytes>size) {
+			if (ptr) cudaFree(ptr); // waits for the transforms using it
+			cudaMalloc(&ptr,bytes);
+			size = bytes;
+		}
+		return ptr;
+	}
+
+	std::size_t bytes() const { return size; }
+
+};
+#endif
+
+// where the elements of a batch of fields are: element i of field b is
+// at b*dist+i*stride; a dist of 0 means the fields are packed
+struct FFTLayout { std::size_t stride = 1, dist = 0; };
+
+/**
+ *  Batched real-to-complex transforms of rank-dimensional fields. Like
+ *  the rest of quakins, dimension 0 varies fastest. The real fields are
+ *  stored padded, with shape n_embed, the complex ones are dense, n[0]/2+1
+ *  by n[1] by ... each; by default the fields are one after the other,
+ *  FFTLayout allows interleaved ones, e.g. one field per column of f.
+ *  The plans are made once here, a call is one transform of all the
+ *  fields. The inverse is not normalized and may overwrite its input.
+ *  Solvers get their FFT from fft_plan() in FFTPlanCache.hpp rather than
+ *  making their own, so equal transforms share one plan; the transforms
+ *  of one plan take turns, for solvers on different threads.
+ */
+template <typename val_type, std::size_t rank>
+class FFT {
+
+	static_assert(std::is_same_v<val_type,float>
+							|| std::is_same_v<val_type,double>,
+							"FFT is float or double");
+	static constexpr bool is_float = std::is_same_v<val_type,float>;
+
+public:
+	using complex_type = thrust::complex<val_type>;
+
+private:
+#ifdef QUAKINS_HOST
+	using plan_type = std::conditional_t<is_float,fftwf_plan,fftw_plan>;
+	plan_type plan_fwd, plan_inv;
+#else
+	cufftHandle plan_fwd, plan_inv;
+	std::size_t work_size = 0; // bytes of FFTWorkspace needed
+#endif
+	std::size_t n_real, n_complex; // elements of one field
+	std::mutex mtx; // one transform at a time
+
+public:
+	FFT(std::array<std::size_t,rank> n, std::array<std::size_t,rank> n_embed,
+			std::size_t n_batch = 1, FFTLayout real = {}, FFTLayout cplx = {}) {
+
+		// the FFT libraries want the slowest dimension first
+		int _n[rank], _inembed[rank], _onembed[rank];
+		n_real = 1; n_complex = 1;
+		for (std::size_t i=0; i<rank; i++) {
+			_n[rank-1-i] = n[i];
+			_inembed[rank-1-i] = n_embed[i];
+			_onembed[rank-1-i] = i==0? n[0]/2+1 : n[i];
+			n_real *= n_embed[i];
+			n_complex *= _onembed[rank-1-i];
+		}
+		int batch = n_batch;
+		int r_stride = real.stride, c_stride = cplx.stride;
+		int r_dist = real.dist? real.dist : n_real;
+		int c_dist = cplx.dist? cplx.dist : n_complex;
+
+#ifdef QUAKINS_HOST
+#ifdef _OPENMP
+		// the plans made from here on use all the threads (-lfftw3_omp)
+		static bool threaded = [] {
+			if constexpr (is_float) {
+				fftwf_init_threads(); fftwf_plan_with_nthreads(omp_get_max_threads());
+			} else {
+				fftw_init_threads(); fftw_plan_with_nthreads(omp_get_max_threads());
+			}
+			return true;
+		}();
+		(void)threaded;
+#endif
+		// FFTW plans on real arrays, FFTW_ESTIMATE leaves them untouched
+		std::vector<val_type> in((n_batch-1)*r_dist+(n_real-1)*r_stride+1);
+		std::vector<complex_type> out((n_batch-1)*c_dist+(n_complex-1)*c_stride+1);
+		unsigned flags = FFTW_ESTIMATE | FFTW_UNALIGNED;
+		if constexpr (is_float) {
+			auto out_ptr = reinterpret_cast<fftwf_complex*>(out.data());
+			plan_fwd = fftwf_plan_many_dft_r2c(rank,_n,batch,in.data(),_inembed,
+								r_stride,r_dist,out_ptr,_onembed,c_stride,c_dist,flags);
+			plan_inv = fftwf_plan_many_dft_c2r(rank,_n,batch,out_ptr,_onembed,
+								c_stride,c_dist,in.data(),_inembed,r_stride,r_dist,flags);
+		} else {
+			auto out_ptr = reinterpret_cast<fftw_complex*>(out.data());
+			plan_fwd = fftw_plan_many_dft_r2c(rank,_n,batch,in.data(),_inembed,
+								r_stride,r_dist,out_ptr,_onembed,c_stride,c_dist,flags);
+			plan_inv = fftw_plan_many_dft_c2r(rank,_n,batch,out_ptr,_onembed,
+								c_stride,c_dist,in.data(),_inembed,r_stride,r_dist,flags);
+		}
+#else
+		// no work area of their own, see FFTWorkspace
+		std::size_t ws_fwd = 0, ws_inv = 0;
+		cufftCreate(&plan_fwd); cufftSetAutoAllocation(plan_fwd,0);
+		cufftCreate(&plan_inv); cufftSetAutoAllocation(plan_inv,0);
+		cufftMakePlanMany(plan_fwd,rank,_n,_inembed,r_stride,r_dist,_onembed,
+							c_stride,c_dist,is_float? CUFFT_R2C:CUFFT_D2Z,batch,&ws_fwd);
+		cufftMakePlanMany(plan_inv,rank,_n,_onembed,c_stride,c_dist,_inembed,
+							r_stride,r_dist,is_float? CUFFT_C2R:CUFFT_Z2D,batch,&ws_inv);
+		work_size = std::max(ws_fwd,ws_inv);
+#endif
+	}
+
+	FFT(const FFT&) = delete;
+	FFT& operator=(const FFT&) = delete;
+
+	~FFT() {
+#ifdef QUAKINS_HOST
+		if constexpr (is_float) {
+			fftwf_destroy_plan(plan_fwd); fftwf_destroy_plan(plan_inv);
+		} else {
+			fftw_destroy_plan(plan_fwd); fftw_destroy_plan(plan_inv);
+		}
+#else
+		cufftDestroy(plan_fwd); cufftDestroy(plan_inv);
+#endif
+	}
+
+	// complex values per field
+	std::size_t complex_size() const { return n_complex; }
+
+	void forward(const val_type* in, complex_type* out) {
+		std::lock_guard<std::mutex> lock(mtx);
+		auto _in = const_cast<val_type*>(in);
+#ifdef QUAKINS_HOST
+		if constexpr (is_float)
+			fftwf_execute_dft_r2c(plan_fwd,_in,
+				reinterpret_cast<fftwf_complex*>(out));
+		else
+			fftw_execute_dft_r2c(plan_fwd,_in,
+				reinterpret_cast<fftw_complex*>(out));
+#else
+		cufftSetWorkArea(plan_fwd,FFTWorkspace::instance().get(work_size));
+		if constexpr (is_float)
+			cufftExecR2C(plan_fwd,_in,reinterpret_cast<cufftComplex*>(out));
+		else
+			cufftExecD2Z(plan_fwd,_in,reinterpret_cast<cufftDoubleComplex*>(out));
+#endif
+	}
+
+	void backward(complex_type* in, val_type* out) {
+		std::lock_guard<std::mutex> lock(mtx);
+#ifdef QUAKINS_HOST
+		if constexpr (is_float)
+			fftwf_execute_dft_c2r(plan_inv,
+				reinterpret_cast<fftwf_complex*>(in),out);
+		else
+			fftw_execute_dft_c2r(plan_inv,
+				reinterpret_cast<fftw_complex*>(in),out);
+#else
+		cufftSetWorkArea(plan_inv,FFTWorkspace::instance().get(work_size));
+		if constexpr (is_float)
+			cufftExecC2R(plan_inv,reinterpret_cast<cufftComplex*>(in),out);
+		else
+			cufftExecZ2D(plan_inv,reinterpret_cast<cufftDoubleComplex*>(in),out);
+#endif
+	}
+
+};
+
+} // namespace quakins
+
+#endif /* _FFT_HPP_ */
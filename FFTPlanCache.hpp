@@ -0,0 +1,79 @@
+#ifndef _FFT_PLAN_CACHE_HPP_
+#define _FFT_PLAN_CACHE_HPP_
+
+#include "FFT.hpp"
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+
+namespace quakins {
+
+/**
+ *  The FFT plans of the process, one cache per precision and rank (the
+ *  backend is fixed at compile time), keyed by the sizes, the batch and
+ *  the layouts. Solvers hold their plan by shared_ptr, so building many
+ *  solvers of the same shape, e.g. for a parameter sweep, plans once.
+ *  The cache keeps the plans after their solvers are gone;
+ *  release_unused() drops those. A plan may be executed from several
+ *  threads, the transforms wait for each other.
+ */
+template <typename val_type, std::size_t rank>
+class FFTPlanCache {
+
+	using IntArray = std::array<std::size_t,rank>;
+	using key_type = std::tuple<IntArray,IntArray,std::size_t,
+						std::size_t,std::size_t,std::size_t,std::size_t>;
+
+	std::mutex mtx;
+	std::map<key_type,std::shared_ptr<FFT<val_type,rank>>> plans;
+
+	FFTPlanCache() = default;
+
+public:
+	FFTPlanCache(const FFTPlanCache&) = delete;
+	FFTPlanCache& operator=(const FFTPlanCache&) = delete;
+
+	static FFTPlanCache& instance() {
+		static FFTPlanCache cache;
+		return cache;
+	}
+
+	// same arguments as the FFT constructor
+	std::shared_ptr<FFT<val_type,rank>>
+	get(IntArray n, IntArray n_embed, std::size_t n_batch = 1,
+			FFTLayout real = {}, FFTLayout cplx = {}) {
+
+		key_type key{n,n_embed,n_batch,
+								 real.stride,real.dist,cplx.stride,cplx.dist};
+		std::lock_guard<std::mutex> lock(mtx);
+		auto& plan = plans[key];
+		if (!plan)
+			plan = std::make_shared<FFT<val_type,rank>>(n,n_embed,n_batch,real,cplx);
+		return plan;
+	}
+
+	std::size_t size() {
+		std::lock_guard<std::mutex> lock(mtx);
+		return plans.size();
+	}
+
+	// destroys the plans no solver holds any more
+	void release_unused() {
+		std::lock_guard<std::mutex> lock(mtx);
+		for (auto it=plans.begin(); it!=plans.end(); )
+			it = it->second.use_count()==1? plans.erase(it) : std::next(it);
+	}
+
+};
+
+template <typename val_type, std::size_t rank>
+std::shared_ptr<FFT<val_type,rank>>
+fft_plan(std::array<std::size_t,rank> n, std::array<std::size_t,rank> n_embed,
+				 std::size_t n_batch = 1, FFTLayout real = {}, FFTLayout cplx = {}) {
+	return FFTPlanCache<val_type,rank>::instance().get(n,n_embed,n_batch,real,cplx);
+}
+
+} // namespace quakins
+
+#endif /* _FFT_PLAN_CACHE_HPP_ */
@@ -2,6 +2,12 @@
 #define _FREE_STREAM_SOLVER_HPP_
 #include "WignerFunction.hpp"
 #include "CoordinateSystem.hpp"
+#include "BoundaryCondition.hpp"
+#include "DensityReducer.hpp"
+#ifdef QUAKINS_HOST
+#include "LineAdvector.hpp"
+#include <vector>
+#endif
 
 #include <thrust/tuple.h>
 #include <thrust/copy.h>
@@ -10,7 +16,12 @@
 #include <thrust/execution_policy.h>
 #include <thrust/functional.h>
 #include <thrust/transform.h>
+#include <thrust/iterator/counting_iterator.h>
+#include <thrust/type_traits/is_contiguous_iterator.h>
 #include <fstream>
+#include <cassert>
+#include <type_traits>
+#include <algorithm>
 
 namespace quakins {
 namespace fbm {
@@ -68,15 +79,43 @@ class strided_chunk_range
     int chunk;
 };
 
+// memory distance between neighbours along the advected axis and 
+// between neighbouring rows of its velocity
+struct AxisStride { std::size_t x, v; };
+
+#ifdef __CUDACC__
+// one block per line of a contiguous axis, the blocks striding over all
+// n_line lines
+template <typename solver_type, typename val_type>
+__global__ void tiled_sweep_kernel(val_type* f, LineBoundary<val_type> lb,
+																	 const val_type* alpha, bool filled,
+																	 std::size_t n_line) {
+	for (std::size_t l=blockIdx.x; l<n_line; l+=gridDim.x) {
+		std::size_t idx = lb.line_begin(l);
+		solver_type::sweep_tile(f,idx,lb,alpha[(idx/lb.v_stride)%lb.nv],filled);
+	}
+}
+#endif
+
 template <typename val_type, std::size_t dim, std::size_t ndim>
 struct FreeStreamSolver {
 	
 	std::size_t nx, nv, nBd, nTot, vdim;
-	thrust::device_vector<val_type> Phi; 		// flux function
+	AxisStride natural; // strides in the layout of the CoordinateSystem
 	thrust::device_vector<val_type> alpha;	// shift length
+	thrust::device_vector<std::size_t> mirror; // row of -v, for reflection
+	thrust::device_vector<val_type> dv_weight; // quadrature, per velocity point
+	thrust::device_vector<val_type> dens_part; // partial densities
+	Boundary<val_type> bd;
 	val_type h;  // spactial interval
+	static constexpr std::size_t tile = 128; // cells per block and tile
+#ifdef QUAKINS_HOST
+	// the vectorized line kernel, QUAKINS_SIMD or the widest there is
+	std::shared_ptr<LineAdvector<val_type>> simd = line_advector<val_type>();
+#endif
 
-	FreeStreamSolver(const CoordinateSystem<val_type,dim>& coord,val_type dt) {
+	FreeStreamSolver(const CoordinateSystem<val_type,dim>& coord,val_type dt,
+									 Boundary<val_type> bd = {}) : bd(bd) {
 
 		nBd  = coord.nBd[ndim];
 		nx   = coord.nz[ndim];
@@ -85,10 +124,13 @@ struct FreeStreamSolver {
 		h    = coord.dz[ndim];
 		nTot = thrust::reduce(coord.nzTot.begin(), coord.nzTot.end(),1,
 													thrust::multiplies<std::size_t>());
-		
-		// prepare the flux function
-		thrust::host_vector<val_type> _Phi(nTot);
-		Phi  = _Phi; //to device
+		natural.x = thrust::reduce(coord.nzTot.begin(), coord.nzTot.begin()+ndim,
+													1, thrust::multiplies<std::size_t>());
+		natural.v = thrust::reduce(coord.nzTot.begin(), coord.nzTot.begin()+vdim,
+													1, thrust::multiplies<std::size_t>());
+		// a filled ghost zone must hold the whole stencil
+		assert(nBd>=2 || (bd.type!=BoundaryType::reflecting 
+											 && bd.type!=BoundaryType::external)); 
 
 		// calculate shift wihtin dt
 		thrust::host_vector<val_type> _alpha(nv);
@@ -97,76 +139,392 @@ struct FreeStreamSolver {
 		 	[&](auto &v){ return v*dt/h; 	}); // v<0
 		
 			alpha = _alpha;  // to device
+			mirror = mirror_rows(coord.coord[vdim]);
+			dv_weight = velocity_weights(coord);
+	}
+
+	// flux \Phi[i+1/2] through the right interface of cell i, 
+	// from f[i-1], f[i], f[i+1] and f[i+2]
+	__host__ __device__
+	static val_type flux(val_type a, val_type fm, 
+											 val_type f0, val_type f1, val_type f2) {
+		if (a<0) 
+			return a*(f1 -(1-a)*(1+a)/6*(f2-f1) 
+									-(2+a)*(1+a)/6*(f1-f0)); // v < 0
+		else
+			return a*(f0 +(1-a)*(2-a)/6*(f1-f0) 
+									+(1-a)*(1+a)/6*(f0-fm)); // v > 0
+	}
+
+	LineBoundary<val_type> line_boundary(AxisStride stride) const {
+		return {bd.type, bd.value, nx, nBd, stride.x, stride.v, nv,
+						thrust::raw_pointer_cast(mirror.data())};
+	}
+
+	// fill the ghost zones, the advection itself only needs this for
+	// reflecting walls, the other types are read through wrapped indices
+	template <typename itor_type>
+	void boundary(itor_type itor_begin, AxisStride stride) {
+		fill_ghosts(itor_begin,nTot,line_boundary(stride));
 	}
-			
+
+	// the advected axis is the fastest varying one and its velocity is 
+	// the outermost, n_chunk elements per velocity row
 	template <typename itor_type>
 	void operator()(itor_type itor_begin, std::size_t n_chunk) {
+		(*this)(itor_begin,AxisStride{1,n_chunk});
+	}
+	template <typename in_itor_type, typename out_itor_type>
+	void operator()(in_itor_type in_begin, out_itor_type out_begin,
+									std::size_t n_chunk) {
+		(*this)(in_begin,out_begin,AxisStride{1,n_chunk});
+	}
+
+	// f in the layout of the CoordinateSystem, no transpose needed
+	template <typename itor_type>
+	void operator()(itor_type itor_begin) {
+		(*this)(itor_begin,natural);
+	}
+	template <typename in_itor_type, typename out_itor_type>
+	requires (!std::is_integral_v<out_itor_type>)
+	void operator()(in_itor_type in_begin, out_itor_type out_begin) {
+		(*this)(in_begin,out_begin,natural);
+	}
+
+#ifdef QUAKINS_HOST
+	// by name, "thrust" for the lambdas below
+	void select_kernel(std::string name) { simd = line_advector<val_type>(name); }
+
+	// the line starting at idx by the line kernel: its cells and two 
+	// ghosts on either side gathered into buf, the new values written to 
+	// out directly if the axis is contiguous, else through buf; the ghosts
+	// are copied through when out is not in
+	static void host_line(const LineAdvector<val_type>* simd,
+												const val_type* in, val_type* out, std::size_t idx,
+												const LineBoundary<val_type>& lb, val_type a, 
+												bool filled, val_type* buf) {
+		std::size_t s = lb.x_stride, nx = lb.nx;
+		std::ptrdiff_t lo = lb.nBd, hi = lb.nBd+lb.nx;
+		val_type *line = buf, *phi = buf+nx+4, *g = phi+nx+1;
+
+		for (std::ptrdiff_t p=lo-2; p<hi+2; p++) 
+			line[p-lo+2] = filled || (p>=lo && p<hi)? 
+				in[idx+p*s] : lb.read(in,idx,p);
+		simd->advect(line,s==1? out+idx+lo : g,phi,nx,a);
+		if (s!=1)
+			for (std::size_t i=0; i<nx; i++) out[idx+(lo+i)*s] = g[i];
+		if (in!=out) 
+			for (std::ptrdiff_t p=0; p<lo; p++) {
+				out[idx+p*s] = in[idx+p*s];
+				out[idx+(hi+p)*s] = in[idx+(hi+p)*s];
+			}
+	}
+#endif
+
+	// advect in place, each line (nx cells and the ghosts) is swept by 
+	// one thread keeping the stencil and the left flux in registers;
+	// for a strided axis neighbouring threads hold neighbouring lines, 
+	// so every step of the sweep is a coalesced access. Along a 
+	// contiguous axis they would be a line apart, so there the device
+	// sweeps a line by a block of its own, tile cells at a time
+	template <typename itor_type>
+	void operator()(itor_type itor_begin, AxisStride stride) {
 				
-		// the outermost dimension is calculated sequentially
-		std::size_t n_step = nTot/n_chunk; 
-		
-		// Boundary Condition
-		strided_chunk_range<itor_type> 
-			left_inside(itor_begin+nBd,itor_begin+nTot,nx+2*nBd, nBd);
-		strided_chunk_range<itor_type> 
-			left_outside(itor_begin,itor_begin+nTot,nx+2*nBd, nBd);
-		strided_chunk_range<itor_type> 
-			right_inside(itor_begin+nx,itor_begin+nTot,nx+2*nBd, nBd);
-		strided_chunk_range<itor_type> 
-			right_outside(itor_begin+nx+nBd,itor_begin+nTot,nx+2*nBd, nBd);
-
-		thrust::copy(left_inside.begin(),left_inside.end(),
-										right_outside.begin());
-		thrust::copy(right_inside.begin(),right_inside.end(),
-										left_outside.begin());
-
-
-		// calculate the flux function \Phi
-		auto zitor_pos_begin 
-			= make_zip_iterator(thrust::make_tuple(
-																			Phi.begin() + nTot/2,
-																			itor_begin-1 + nTot/2,
-																			itor_begin + nTot/2,  
-																			itor_begin+1 +nTot/2));
-		auto zitor_neg_begin 
-			=	make_zip_iterator(thrust::make_tuple(
-																			Phi.begin(),
-																			itor_begin,
-																			itor_begin+1,  
-																			itor_begin+2));
-
-		for (std::size_t i = 0; i<n_step/2; i++) {
-
-			thrust::for_each(zitor_neg_begin+nBd-1,
-											zitor_neg_begin+n_chunk-nBd+1,
-			[a=alpha[i]](auto tuple){
-				thrust::get<0>(tuple) = a*(thrust::get<2>(tuple) 
-				-(1-a)*(1+a)/6*(thrust::get<3>(tuple)-thrust::get<2>(tuple))
-				-(2+a)*(1+a)/6*(thrust::get<2>(tuple)-thrust::get<1>(tuple)));
-			});
-			zitor_neg_begin += n_chunk;
-		} // v < 0
-	
-		for (std::size_t i = n_step/2; i<n_step; i++) {
-
-			thrust::for_each(zitor_pos_begin+nBd-1,
-											zitor_pos_begin+n_chunk-nBd+1,
-										[a=alpha[i]](auto tuple){
-				thrust::get<0>(tuple) = a*(thrust::get<2>(tuple) 
-				+(1-a)*(2-a)/6*(thrust::get<3>(tuple)-thrust::get<2>(tuple))
-				+(1-a)*(1+a)/6*(thrust::get<2>(tuple)-thrust::get<1>(tuple)));
+		auto lb = line_boundary(stride);
+		bool filled = lb.type==BoundaryType::reflecting 
+							 || lb.type==BoundaryType::external;
+		if (lb.type==BoundaryType::reflecting) fill_ghosts(itor_begin,nTot,lb);
+
+		auto alpha_ptr = thrust::raw_pointer_cast(alpha.data());
+
+#ifdef __CUDACC__
+		if constexpr (std::is_arithmetic_v<val_type> &&
+									thrust::is_contiguous_iterator_v<itor_type>) 
+		if (lb.x_stride==1) {
+			std::size_t n_line = nTot/lb.n_line();
+			tiled_sweep_kernel<FreeStreamSolver>
+				<<<std::min<std::size_t>(n_line,1<<20),tile>>>(
+				thrust::raw_pointer_cast(&itor_begin[0]),lb,alpha_ptr,filled,n_line);
+			return;
+		}
+#endif
+
+#ifdef QUAKINS_HOST
+		if constexpr (thrust::is_contiguous_iterator_v<itor_type>) if (simd) {
+			auto f = thrust::raw_pointer_cast(&itor_begin[0]);
+			auto kernel = simd.get();
+			thrust::for_each(thrust::make_counting_iterator<std::size_t>(0),
+											thrust::make_counting_iterator(nTot/lb.n_line()),
+			[=](std::size_t line) {
+				thread_local std::vector<val_type> buf;
+				buf.resize(3*lb.nx+5);
+				std::size_t idx = lb.line_begin(line);
+				host_line(kernel,f,f,idx,lb,alpha_ptr[(idx/lb.v_stride)%lb.nv],
+									filled,buf.data());
 			});
-			zitor_pos_begin += n_chunk;
-		} // v > 0
+			return;
+		}
+#endif
+
+		thrust::for_each(thrust::make_counting_iterator<std::size_t>(0),
+										thrust::make_counting_iterator(nTot/lb.n_line()),
+		[=](std::size_t line) {
+			std::size_t idx = lb.line_begin(line);
+			sweep_line(itor_begin,idx,lb,alpha_ptr[(idx/lb.v_stride)%lb.nv],filled);
+		});
+	}
+
+	// the in-place update of the line starting at idx with shift a; the
+	// ghosts are read from memory if filled, else through the boundary
+	template <typename itor_type>
+	__host__ __device__
+	static void sweep_line(itor_type itor_begin, std::size_t idx,
+												 const LineBoundary<val_type>& lb, val_type a, 
+												 bool filled) {
+		std::size_t s = lb.x_stride;
+		std::ptrdiff_t lo = lb.nBd, hi = lb.nBd+lb.nx;
+		auto f = itor_begin + idx;
+
+		// the ghosts reached by the stencil, before f is overwritten
+		val_type gl[2], gr[2];
+		for (int j=0; j<2; j++) {
+			std::ptrdiff_t pl = lo-2+j, pr = hi+j;
+			gl[j] = filled? f[pl*s] : lb.read(itor_begin,idx,pl);
+			gr[j] = filled? f[pr*s] : lb.read(itor_begin,idx,pr);
+		}
 
-		auto zitor_begin = thrust::make_zip_iterator(thrust::make_tuple(
-														itor_begin,Phi.begin()-1,Phi.begin()));
+		val_type fm = gl[0], f0 = gl[1], 
+						 f1 = f[lo*s], f2 = f[(lo+1)*s];
+		val_type phi_l = flux(a,fm,f0,f1,f2), phi_r;
 
 		// calculate f[i](t+dt)=f[i](t) + Phi[i-1/2] -Phi[i+1/2]
-		thrust::for_each(zitor_begin+nBd,zitor_begin
-										+nTot-nBd, [](auto tuple) {
-			thrust::get<0>(tuple) += thrust::get<1>(tuple)
-															-thrust::get<2>(tuple);
+		for (std::ptrdiff_t i=lo; i<hi; i++) {
+			fm = f0; f0 = f1; f1 = f2; 
+			f2 = i+2<hi? f[(i+2)*s] : gr[i+2-hi];
+			phi_r = flux(a,fm,f0,f1,f2);
+			f[i*s] = f0 + (phi_l - phi_r);
+			phi_l = phi_r;
+		}
+	}
+
+#ifdef __CUDACC__
+	// the in-place update of the contiguous line at idx by a block of 
+	// tile threads: buf holds tile cells and the two on either side, read
+	// and written back coalesced. The old values of its last four carry
+	// over to the next tile, and the stencil beyond either end of the 
+	// line is read before any cell is overwritten
+	__device__ static void sweep_tile(val_type* f, std::size_t idx,
+																		const LineBoundary<val_type>& lb, 
+																		val_type a, bool filled) {
+		__shared__ val_type buf[tile+4], ghost[4];
+		std::ptrdiff_t lo = lb.nBd, hi = lb.nBd+lb.nx, t = threadIdx.x;
+		std::ptrdiff_t n = tile;
+
+		__syncthreads(); // the block is done with the previous line
+		if (t<4) {
+			std::ptrdiff_t p = t<2? lo-2+t : hi+t-2;
+			ghost[t] = filled? f[idx+p] : lb.read(f,idx,p);
+		}
+		__syncthreads();
+
+		// buf[j] is position p0-2+j of the line
+		for (std::ptrdiff_t p0=lo; p0<hi; p0+=n) {
+			if (p0==lo && t<2) buf[t] = ghost[t];
+			for (std::ptrdiff_t j=t+(p0==lo? 2:4); j<n+4; j+=n) {
+				std::ptrdiff_t p = p0-2+j;
+				buf[j] = p<hi? f[idx+p] : p<hi+2? ghost[2+p-hi] : val_type(0);
+			}
+			__syncthreads();
+			val_type fnew = buf[t+2] + (flux(a,buf[t],buf[t+1],buf[t+2],buf[t+3])
+																 -flux(a,buf[t+1],buf[t+2],buf[t+3],buf[t+4]));
+			__syncthreads();
+			if (t<4) buf[t] = buf[n+t];
+			if (p0+t<hi) f[idx+p0+t] = fnew;
+			__syncthreads();
+		}
+	}
+#endif
+
+	// f[idx](t+dt) from the input array, the ghost cells are copied through
+	template <typename in_itor_type>
+	__host__ __device__
+	static val_type advect_cell(in_itor_type in_begin, std::size_t idx, 
+															const LineBoundary<val_type>& lb, val_type a) {
+		std::size_t s = lb.x_stride, i = (idx/s)%lb.n_line();
+		std::size_t lo = lb.nBd, hi = lb.nBd+lb.nx;
+		if (i<lo || i>=hi) return in_begin[idx];
+
+		val_type f[5]; // f[i-2] to f[i+2]
+		if (i>=lo+2 && i+2<hi) 
+			for (int d=0; d<5; d++) f[d] = in_begin[idx+(d-2)*s];
+		else 
+			for (int d=0; d<5; d++) 
+				f[d] = lb.read(in_begin,idx-i*s,std::ptrdiff_t(i)+d-2);
+
+		return f[2] + (flux(a,f[0],f[1],f[2],f[3]) 
+									-flux(a,f[1],f[2],f[3],f[4]));
+	}
+
+	// advect out of place (ping-pong), the fluxes are computed on the fly
+	// and no ghost zone has to be filled
+	template <typename in_itor_type, typename out_itor_type>
+	void operator()(in_itor_type in_begin, out_itor_type out_begin,
+									AxisStride stride) {
+
+		auto lb = line_boundary(stride);
+		auto alpha_ptr = thrust::raw_pointer_cast(alpha.data());
+
+#ifdef QUAKINS_HOST
+		if constexpr (thrust::is_contiguous_iterator_v<in_itor_type> &&
+									thrust::is_contiguous_iterator_v<out_itor_type>) if (simd) {
+			auto in = thrust::raw_pointer_cast(&in_begin[0]);
+			auto out = thrust::raw_pointer_cast(&out_begin[0]);
+			auto kernel = simd.get();
+			thrust::for_each(thrust::make_counting_iterator<std::size_t>(0),
+											thrust::make_counting_iterator(nTot/lb.n_line()),
+			[=](std::size_t line) {
+				thread_local std::vector<val_type> buf;
+				buf.resize(3*lb.nx+5);
+				std::size_t idx = lb.line_begin(line);
+				host_line(kernel,in,out,idx,lb,alpha_ptr[(idx/lb.v_stride)%lb.nv],
+									false,buf.data());
+			});
+			return;
+		}
+#endif
+
+		thrust::for_each(thrust::make_counting_iterator<std::size_t>(0),
+										thrust::make_counting_iterator(nTot),
+		[=](std::size_t idx) {
+			out_begin[idx] = advect_cell(in_begin,idx,lb,
+																	 alpha_ptr[(idx/lb.v_stride)%lb.nv]);
+		});
+	}
+
+	// the ping-pong advection in two parts, so that the ghosts can be 
+	// exchanged while the first runs: the cells whose stencil stays inside
+	// the line, then the two cells next to either end and the ghosts, 
+	// which are copied through
+	template <typename in_itor_type, typename out_itor_type>
+	void advect_interior(in_itor_type in_begin, out_itor_type out_begin,
+											 AxisStride stride) {
+		advect_part(in_begin,out_begin,stride,true);
+	}
+	template <typename in_itor_type, typename out_itor_type>
+	void advect_edges(in_itor_type in_begin, out_itor_type out_begin,
+										AxisStride stride) {
+		advect_part(in_begin,out_begin,stride,false);
+	}
+	template <typename in_itor_type, typename out_itor_type>
+	void advect_interior(in_itor_type in_begin, out_itor_type out_begin) {
+		advect_part(in_begin,out_begin,natural,true);
+	}
+	template <typename in_itor_type, typename out_itor_type>
+	void advect_edges(in_itor_type in_begin, out_itor_type out_begin) {
+		advect_part(in_begin,out_begin,natural,false);
+	}
+
+	template <typename in_itor_type, typename out_itor_type>
+	void advect_part(in_itor_type in_begin, out_itor_type out_begin,
+									 AxisStride stride, bool interior) {
+
+		assert(nx>=4);
+		auto lb = line_boundary(stride);
+		auto alpha_ptr = thrust::raw_pointer_cast(alpha.data());
+		// per line nx-4 cells from nBd+2 on, or nBd+2 positions at either end
+		std::size_t n_cell = interior? nx-4 : 2*(nBd+2);
+
+		thrust::for_each(thrust::make_counting_iterator<std::size_t>(0),
+										thrust::make_counting_iterator(nTot/lb.n_line()*n_cell),
+		[=](std::size_t t) {
+			std::size_t j = t%n_cell, nb = lb.nBd+2;
+			std::size_t p = interior? nb+j : j<nb? j : lb.nx+j-4;
+			std::size_t idx = lb.line_begin(t/n_cell) + p*lb.x_stride;
+			out_begin[idx] = advect_cell(in_begin,idx,lb,
+																	 alpha_ptr[(idx/lb.v_stride)%lb.nv]);
+		});
+	}
+
+	// ping-pong advection in the layout of the CoordinateSystem that also
+	// integrates the new f over all velocity axes, so the density needs no
+	// further pass over f. Every thread keeps one spatial point and walks 
+	// a part of its velocities, the n_part partial sums are added up after.
+	template <typename in_itor_type, typename out_itor_type, 
+						typename dens_itor_type>
+	void advect_with_density(in_itor_type in_begin, out_itor_type out_begin,
+													 dens_itor_type dens_begin) {
+
+		auto lb = line_boundary(natural);
+		auto alpha_ptr = thrust::raw_pointer_cast(alpha.data());
+		auto w_ptr = thrust::raw_pointer_cast(dv_weight.data());
+
+		std::size_t n_seg = dv_weight.size(), n_space = nTot/n_seg;
+		// enough threads to fill the device, at most one per velocity
+		std::size_t n_part = std::min(n_seg,(std::size_t(1<<16)+n_space-1)/n_space);
+		std::size_t seg_part = (n_seg+n_part-1)/n_part;
+		dens_part.resize(n_part*n_space);
+		auto part_ptr = thrust::raw_pointer_cast(dens_part.data());
+
+#ifdef QUAKINS_HOST
+		// by whole lines, the partial sums of a line's points are then 
+		// contiguous if its axis is; the same partition into n_part keeps
+		// the sums in the same order as the lambdas below
+		if constexpr (thrust::is_contiguous_iterator_v<in_itor_type> &&
+									thrust::is_contiguous_iterator_v<out_itor_type>) if (simd) {
+			auto in = thrust::raw_pointer_cast(&in_begin[0]);
+			auto out = thrust::raw_pointer_cast(&out_begin[0]);
+			auto kernel = simd.get();
+			std::size_t n_lps = n_space/lb.n_line(); // lines per segment
+			thrust::for_each(thrust::make_counting_iterator<std::size_t>(0),
+											thrust::make_counting_iterator(n_part*n_lps),
+			[=](std::size_t t) {
+				thread_local std::vector<val_type> buf;
+				buf.resize(3*lb.nx+5);
+				std::size_t b = lb.line_begin(t%n_lps), p = t/n_lps;
+				std::size_t n = lb.n_line(), s = lb.x_stride;
+				val_type* sum = part_ptr+p*n_space+b;
+				for (std::size_t i=0; i<n; i++) sum[i*s] = 0;
+				for (std::size_t k=p*seg_part; k<n_seg && k<(p+1)*seg_part; k++) {
+					std::size_t idx = k*n_space+b;
+					host_line(kernel,in,out,idx,lb,alpha_ptr[(idx/lb.v_stride)%lb.nv],
+										false,buf.data());
+					if (s==1) kernel->accumulate(sum,out+idx,n,w_ptr[k]);
+					else for (std::size_t i=0; i<n; i++) sum[i*s] += w_ptr[k]*out[idx+i*s];
+				}
+			});
+			sum_parts(dens_begin,n_part,n_space);
+			return;
+		}
+#endif
+
+		thrust::for_each(thrust::make_counting_iterator<std::size_t>(0),
+										thrust::make_counting_iterator(n_part*n_space),
+		[=](std::size_t t) {
+			std::size_t b = t%n_space, p = t/n_space;
+			val_type sum = 0;
+			for (std::size_t s=p*seg_part; s<n_seg && s<(p+1)*seg_part; s++) {
+				std::size_t idx = s*n_space+b;
+				val_type f = advect_cell(in_begin,idx,lb,
+																 alpha_ptr[(idx/lb.v_stride)%lb.nv]);
+				out_begin[idx] = f;
+				sum += w_ptr[s]*f;
+			}
+			part_ptr[t] = sum;
+		});
+		sum_parts(dens_begin,n_part,n_space);
+	}
+
+	// the density from the n_part partial sums of every spatial point
+	template <typename dens_itor_type>
+	void sum_parts(dens_itor_type dens_begin, 
+								 std::size_t n_part, std::size_t n_space) {
+		auto part_ptr = thrust::raw_pointer_cast(dens_part.data());
+		thrust::for_each(thrust::make_counting_iterator<std::size_t>(0),
+										thrust::make_counting_iterator(n_space),
+		[=](std::size_t b) {
+			val_type sum = 0;
+			for (std::size_t p=0; p<n_part; p++) sum += part_ptr[p*n_space+b];
+			dens_begin[b] = sum;
 		});
 	}
 };
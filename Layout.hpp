@@ -0,0 +1,108 @@
+#ifndef _LAYOUT_HPP_
+#define _LAYOUT_HPP_
+
+#include <thrust/detail/config.h>
+#include <array>
+#include <utility>
+#include <cassert>
+#include <cstddef>
+
+namespace quakins {
+
+// Multi-array layouts, dimension 0 varies fastest. The strides are
+// computed once, an index conversion is dim divisions/multiplications.
+
+template <std::size_t dim>
+struct Layout {
+
+	std::array<std::size_t,dim> n, stride;
+	std::size_t n_tot;
+
+	Layout(std::array<std::size_t,dim> n) : n(n) {
+		n_tot = 1;
+		for (std::size_t i=0; i<dim; i++) {
+			stride[i] = n_tot;
+			n_tot *= n[i];
+		}
+	}
+
+	__host__ __device__
+	std::array<std::size_t,dim> idxS2M(std::size_t idx_s) const {
+		std::array<std::size_t,dim> idx_m;
+		for (std::size_t i=0; i<dim; i++)
+			idx_m[i] = idx_s/stride[i]%n[i];
+		return idx_m;
+	}
+
+	__host__ __device__
+	std::size_t idxM2S(const std::array<std::size_t,dim>& idx_m) const {
+		std::size_t idx_s = 0;
+		for (std::size_t i=0; i<dim; i++)
+			idx_s += idx_m[i]*stride[i];
+		return idx_s;
+	}
+
+};
+
+// the shape is known at compile time, so are the strides, and the
+// divisions become multiplications by the compiler
+template <std::size_t... N>
+struct StaticLayout {
+
+	static constexpr std::size_t dim = sizeof...(N);
+	static constexpr std::size_t n_tot = (N * ...);
+
+	template <std::size_t I>
+	__host__ __device__
+	static constexpr std::size_t n() {
+		constexpr std::size_t _n[dim] = {N...};
+		return _n[I];
+	}
+
+	template <std::size_t I>
+	__host__ __device__
+	static constexpr std::size_t stride() {
+		constexpr std::size_t _n[dim] = {N...};
+		std::size_t s = 1;
+		for (std::size_t i=0; i<I; i++) s *= _n[i];
+		return s;
+	}
+
+	constexpr StaticLayout() {}
+
+	// interchangeable with Layout, the runtime shape must match
+	StaticLayout(std::array<std::size_t,dim> n_dim) {
+		assert((n_dim == std::array<std::size_t,dim>{N...}));
+	}
+
+	__host__ __device__
+	static constexpr std::array<std::size_t,dim> idxS2M(std::size_t idx_s) {
+		return idxS2M(idx_s,std::make_index_sequence<dim>{});
+	}
+
+	__host__ __device__
+	static constexpr std::size_t
+	idxM2S(const std::array<std::size_t,dim>& idx_m) {
+		return idxM2S(idx_m,std::make_index_sequence<dim>{});
+	}
+
+private:
+	template <std::size_t... I>
+	__host__ __device__
+	static constexpr std::array<std::size_t,dim>
+	idxS2M(std::size_t idx_s, std::index_sequence<I...>) {
+		return {(idx_s/stride<I>()%n<I>())...};
+	}
+
+	template <std::size_t... I>
+	__host__ __device__
+	static constexpr std::size_t
+	idxM2S(const std::array<std::size_t,dim>& idx_m, std::index_sequence<I...>) {
+		return ((idx_m[I]*stride<I>()) + ...);
+	}
+
+};
+
+} // namespace quakins
+
+#endif /* _LAYOUT_HPP_ */
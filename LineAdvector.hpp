@@ -0,0 +1,233 @@
+#ifndef _LINE_ADVECTOR_HPP_
+#define _LINE_ADVECTOR_HPP_
+
+#include <thrust/host_vector.h>
+#include <thrust/device_vector.h>
+#include "util.hpp"
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#endif
+
+/**
+ *  The advection of one line on the host backends, vectorized by hand:
+ *  the zip-iterator lambdas of FreeStreamSolver leave the compiler a
+ *  data-dependent branch per cell and one line per thread, which it does
+ *  not turn into SIMD code. The kernels are registered by name in the
+ *  Proxy of util.hpp, "scalar" for any val_type and "avx2" and "avx512"
+ *  for float, and line_advector() picks the widest one the CPU supports.
+ *
+ *  They compute what FreeStreamSolver::flux does in the same order of
+ *  operations, without contracting into FMAs, so the result is the same
+ *  to the bit as long as the compiler does not contract the thrust one.
+ */
+namespace quakins {
+namespace fbm {
+
+template <typename val_type>
+struct LineAdvector {
+	virtual ~LineAdvector() {}
+
+	// whether the CPU it runs on has the instructions
+	virtual bool supported() const = 0;
+
+	// g[i] = f[i+2] +Phi[i-1/2] -Phi[i+1/2] for the n cells of a line,
+	// with f holding them and two ghosts on either side, shift a; phi
+	// is n+1 values of scratch
+	virtual void advect(const val_type* f, val_type* g, val_type* phi,
+											std::size_t n, val_type a) const = 0;
+
+	// sum[i] += w*g[i], a velocity integral
+	virtual void accumulate(val_type* sum, const val_type* g,
+													std::size_t n, val_type w) const = 0;
+};
+
+template <typename val_type>
+struct ScalarLineAdvector : LineAdvector<val_type> {
+
+	bool supported() const override { return true; }
+
+	// phi[k] = Phi[k-1/2] for k in [k0,k1), the branch on the sign of a
+	// is taken once for the whole line
+	static void fluxes(const val_type* f, val_type* phi,
+										 std::size_t k0, std::size_t k1, val_type a) {
+		if (a<0) {
+			val_type c1 = (1-a)*(1+a)/6, c2 = (2+a)*(1+a)/6;
+			for (std::size_t k=k0; k<k1; k++)
+				phi[k] = a*(f[k+2] -c1*(f[k+3]-f[k+2]) -c2*(f[k+2]-f[k+1]));
+		} else {
+			val_type c1 = (1-a)*(2-a)/6, c2 = (1-a)*(1+a)/6;
+			for (std::size_t k=k0; k<k1; k++)
+				phi[k] = a*(f[k+1] +c1*(f[k+2]-f[k+1]) +c2*(f[k+1]-f[k]));
+		}
+	}
+
+	static void update(const val_type* f, val_type* g, const val_type* phi,
+										 std::size_t i0, std::size_t i1) {
+		for (std::size_t i=i0; i<i1; i++) g[i] = f[i+2] + (phi[i]-phi[i+1]);
+	}
+
+	void advect(const val_type* f, val_type* g, val_type* phi,
+							std::size_t n, val_type a) const override {
+		fluxes(f,phi,0,n+1,a);
+		update(f,g,phi,0,n);
+	}
+
+	void accumulate(val_type* sum, const val_type* g,
+									std::size_t n, val_type w) const override {
+		for (std::size_t i=0; i<n; i++) sum[i] += w*g[i];
+	}
+};
+
+#if defined(__x86_64__) && defined(__GNUC__)
+
+// 8 floats per instruction
+struct AVX2LineAdvector : ScalarLineAdvector<float> {
+
+	bool supported() const override { return __builtin_cpu_supports("avx2"); }
+
+	__attribute__((target("avx2"),optimize("fp-contract=off")))
+	void advect(const float* f, float* g, float* phi,
+							std::size_t n, float a) const override {
+		std::size_t k = 0, i = 0;
+		__m256 va = _mm256_set1_ps(a);
+		if (a<0) {
+			__m256 c1 = _mm256_set1_ps((1-a)*(1+a)/6);
+			__m256 c2 = _mm256_set1_ps((2+a)*(1+a)/6);
+			for (; k+8<=n+1; k+=8) {
+				__m256 f0 = _mm256_loadu_ps(f+k+1), f1 = _mm256_loadu_ps(f+k+2),
+							 f2 = _mm256_loadu_ps(f+k+3);
+				__m256 p = _mm256_sub_ps(f1,_mm256_mul_ps(c1,_mm256_sub_ps(f2,f1)));
+				p = _mm256_sub_ps(p,_mm256_mul_ps(c2,_mm256_sub_ps(f1,f0)));
+				_mm256_storeu_ps(phi+k,_mm256_mul_ps(va,p));
+			}
+		} else {
+			__m256 c1 = _mm256_set1_ps((1-a)*(2-a)/6);
+			__m256 c2 = _mm256_set1_ps((1-a)*(1+a)/6);
+			for (; k+8<=n+1; k+=8) {
+				__m256 fm = _mm256_loadu_ps(f+k), f0 = _mm256_loadu_ps(f+k+1),
+							 f1 = _mm256_loadu_ps(f+k+2);
+				__m256 p = _mm256_add_ps(f0,_mm256_mul_ps(c1,_mm256_sub_ps(f1,f0)));
+				p = _mm256_add_ps(p,_mm256_mul_ps(c2,_mm256_sub_ps(f0,fm)));
+				_mm256_storeu_ps(phi+k,_mm256_mul_ps(va,p));
+			}
+		}
+		fluxes(f,phi,k,n+1,a);
+
+		for (; i+8<=n; i+=8) {
+			__m256 d = _mm256_sub_ps(_mm256_loadu_ps(phi+i),_mm256_loadu_ps(phi+i+1));
+			_mm256_storeu_ps(g+i,_mm256_add_ps(_mm256_loadu_ps(f+i+2),d));
+		}
+		update(f,g,phi,i,n);
+	}
+
+	__attribute__((target("avx2"),optimize("fp-contract=off")))
+	void accumulate(float* sum, const float* g,
+									std::size_t n, float w) const override {
+		std::size_t i = 0;
+		__m256 vw = _mm256_set1_ps(w);
+		for (; i+8<=n; i+=8)
+			_mm256_storeu_ps(sum+i,_mm256_add_ps(_mm256_loadu_ps(sum+i),
+				_mm256_mul_ps(vw,_mm256_loadu_ps(g+i))));
+		for (; i<n; i++) sum[i] += w*g[i];
+	}
+};
+
+// 16 floats per instruction
+struct AVX512LineAdvector : ScalarLineAdvector<float> {
+
+	bool supported() const override { return __builtin_cpu_supports("avx512f"); }
+
+	__attribute__((target("avx512f"),optimize("fp-contract=off")))
+	void advect(const float* f, float* g, float* phi,
+							std::size_t n, float a) const override {
+		std::size_t k = 0, i = 0;
+		__m512 va = _mm512_set1_ps(a);
+		if (a<0) {
+			__m512 c1 = _mm512_set1_ps((1-a)*(1+a)/6);
+			__m512 c2 = _mm512_set1_ps((2+a)*(1+a)/6);
+			for (; k+16<=n+1; k+=16) {
+				__m512 f0 = _mm512_loadu_ps(f+k+1), f1 = _mm512_loadu_ps(f+k+2),
+							 f2 = _mm512_loadu_ps(f+k+3);
+				__m512 p = _mm512_sub_ps(f1,_mm512_mul_ps(c1,_mm512_sub_ps(f2,f1)));
+				p = _mm512_sub_ps(p,_mm512_mul_ps(c2,_mm512_sub_ps(f1,f0)));
+				_mm512_storeu_ps(phi+k,_mm512_mul_ps(va,p));
+			}
+		} else {
+			__m512 c1 = _mm512_set1_ps((1-a)*(2-a)/6);
+			__m512 c2 = _mm512_set1_ps((1-a)*(1+a)/6);
+			for (; k+16<=n+1; k+=16) {
+				__m512 fm = _mm512_loadu_ps(f+k), f0 = _mm512_loadu_ps(f+k+1),
+							 f1 = _mm512_loadu_ps(f+k+2);
+				__m512 p = _mm512_add_ps(f0,_mm512_mul_ps(c1,_mm512_sub_ps(f1,f0)));
+				p = _mm512_add_ps(p,_mm512_mul_ps(c2,_mm512_sub_ps(f0,fm)));
+				_mm512_storeu_ps(phi+k,_mm512_mul_ps(va,p));
+			}
+		}
+		fluxes(f,phi,k,n+1,a);
+
+		for (; i+16<=n; i+=16) {
+			__m512 d = _mm512_sub_ps(_mm512_loadu_ps(phi+i),_mm512_loadu_ps(phi+i+1));
+			_mm512_storeu_ps(g+i,_mm512_add_ps(_mm512_loadu_ps(f+i+2),d));
+		}
+		update(f,g,phi,i,n);
+	}
+
+	__attribute__((target("avx512f"),optimize("fp-contract=off")))
+	void accumulate(float* sum, const float* g,
+									std::size_t n, float w) const override {
+		std::size_t i = 0;
+		__m512 vw = _mm512_set1_ps(w);
+		for (; i+16<=n; i+=16)
+			_mm512_storeu_ps(sum+i,_mm512_add_ps(_mm512_loadu_ps(sum+i),
+				_mm512_mul_ps(vw,_mm512_loadu_ps(g+i))));
+		for (; i<n; i++) sum[i] += w*g[i];
+	}
+};
+
+#endif
+
+// the registry, one factory per kernel and val_type
+inline ConcreteFactory<LineAdvector<float>,ScalarLineAdvector<float>>
+	scalar_line_advector_f("scalar");
+inline ConcreteFactory<LineAdvector<double>,ScalarLineAdvector<double>>
+	scalar_line_advector_d("scalar");
+#if defined(__x86_64__) && defined(__GNUC__)
+inline ConcreteFactory<LineAdvector<float>,AVX2LineAdvector>
+	avx2_line_advector("avx2");
+inline ConcreteFactory<LineAdvector<float>,AVX512LineAdvector>
+	avx512_line_advector("avx512");
+#endif
+
+/**
+ *  The kernel called name; with no name the one QUAKINS_SIMD names, else
+ *  the widest the CPU supports. "thrust" gives none, and so does a kernel
+ *  the CPU cannot run: FreeStreamSolver then keeps its thrust lambdas.
+ */
+template <typename val_type>
+std::shared_ptr<LineAdvector<val_type>> line_advector(std::string name = "") {
+
+	auto& proxy = Proxy<LineAdvector<val_type>>::Instance();
+	if (auto env = std::getenv("QUAKINS_SIMD"); name.empty() && env) name = env;
+	if (name=="thrust") return nullptr;
+
+	std::vector<std::string> names{name};
+	if (name.empty()) names = {"avx512","avx2","scalar"};
+	for (auto& n : names) {
+		if (proxy.regedit.find(n)==proxy.regedit.end()) continue;
+		std::shared_ptr<LineAdvector<val_type>> kernel(proxy.get(n));
+		if (kernel->supported()) return kernel;
+		if (!name.empty()) std::cout << "the CPU cannot run the " << n << " kernel" << std::endl;
+	}
+	if (!name.empty() && proxy.regedit.find(name)==proxy.regedit.end())
+		std::cout << "no line kernel named " << name << std::endl;
+	return nullptr;
+}
+
+} // namespace fbm
+} // namespace quakins
+
+#endif /* _LINE_ADVECTOR_HPP_ */
@@ -5,56 +5,45 @@
 #include <thrust/iterator/counting_iterator.h>
 #include <thrust/scatter.h>
 #include "ReorderCopy.hpp"
+#include "Layout.hpp"
 
 namespace quakins {
 
 template <typename val_type, 
 					std::size_t dim,
-				  std::size_t n_tot>
+				  std::size_t n_tot,
+					typename layout_type = Layout<dim>>
 class MemSaveReorderCopy {
 
 	using IntArray = std::array<std::size_t,dim>;
-	IntArray order, n_dim;
+	layout_type in_layout;
+	IntArray out_stride;  // stride in the output of each input axis
 public:
 	MemSaveReorderCopy(IntArray order, IntArray n_dim) 
-		: order(order), n_dim(n_dim) {}
+		: in_layout(n_dim) {
+		std::size_t shift = 1;
+		for (std::size_t k=0; k<dim; k++) {
+			out_stride[order[k]] = shift;
+			shift *= n_dim[order[k]];
+		}
+	}
 
 
 	template <typename InputIterator, typename OutputIterator>
 	void operator()(InputIterator in_itor_begin, OutputIterator out_itor_begin) {
 		
-
-		auto cal_reorder_idx = [l_order=order,l_n_dim=n_dim](int idx_s) {
+		auto cal_reorder_idx = [l_layout=in_layout,
+														l_out_stride=out_stride](std::size_t idx_s) {
 			// transform i to i'.
-
-			std::array<std::size_t,dim> idx_m;
-			idx_m = idxS2M(idx_s,l_n_dim);
-			for (std::size_t i=0; i<dim; i++) {
-				std::size_t imod = thrust::reduce(l_n_dim.begin(),l_n_dim.begin()+i+1,
-															1, thrust::multiplies<std::size_t>());
-				std::size_t idvd = thrust::reduce(l_n_dim.begin(),l_n_dim.begin()+i,
-															1, thrust::multiplies<std::size_t>());
-				idx_m[i] = (idx_s%imod) / idvd;
-			}
-
-			// reorder the multi-indices
-			auto pitor = thrust::make_permutation_iterator(
-															l_n_dim.begin(),l_order.begin());
-			auto idx_pitor = thrust::make_permutation_iterator(
-															idx_m.begin(),l_order.begin());
-
-
-			std::array<std::size_t,dim> shift;	
-			thrust::exclusive_scan(pitor,pitor+dim,shift.begin(),1,
-													thrust::multiplies<std::size_t>());
-
-			return thrust::inner_product(idx_pitor,idx_pitor+dim,
-										shift.begin(),0);
-
+			auto idx_m = l_layout.idxS2M(idx_s);
+			std::size_t idx_out = 0;
+			for (std::size_t i=0; i<dim; i++)
+				idx_out += idx_m[i]*l_out_stride[i];
+			return idx_out;
 		};
 
 		auto titor_begin = thrust::make_transform_iterator(
-						thrust::make_counting_iterator(0), cal_reorder_idx);
+						thrust::make_counting_iterator<std::size_t>(0), cal_reorder_idx);
 	
 		thrust::scatter(in_itor_begin, in_itor_begin+n_tot,
 											titor_begin, out_itor_begin);
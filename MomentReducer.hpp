@@ -0,0 +1,163 @@
+#ifndef _MOMENT_REDUCER_HPP_
+#define _MOMENT_REDUCER_HPP_
+
+#include <thrust/host_vector.h>
+#include <thrust/device_vector.h>
+#include <thrust/for_each.h>
+#include <thrust/iterator/counting_iterator.h>
+#include <array>
+#include "CoordinateSystem.hpp"
+#include "Layout.hpp"
+
+namespace quakins {
+
+// the velocity moments a MomentReducer can be asked for, or-ed together;
+// current and heat_flux have one component per velocity axis
+namespace moment {
+enum type : unsigned {
+	density   = 1,  // \int f dv
+	current   = 2,  // \int v f dv
+	energy    = 4,  // \int |v|^2/2 f dv
+	heat_flux = 8,  // \int v |v|^2/2 f dv
+	all = 15
+};
+}
+
+/**
+ *  Accumulates every requested velocity moment of f in a single read of
+ *  the phase space: one thread per spatial point walks its velocity
+ *  segment, weighted by the Simpson-like weights of DensityReducer and by
+ *  the coordinates of the velocity axes. The spatial axes are the first
+ *  dim/2 axes of the CoordinateSystem, the velocity ones the last dim/2.
+ *  The velocity segments are contiguous if v_inner ({v...,x...} layout),
+ *  otherwise they are interleaved ({x...,v...}, the CoordinateSystem one).
+ */
+template <typename val_type, std::size_t dim, bool v_inner>
+class MomentReducer {
+
+	static constexpr std::size_t vdim = dim/2;
+	// slot 0 density, 1..vdim current, vdim+1 energy, vdim+2.. heat flux
+	static constexpr std::size_t n_slot = 2+2*vdim;
+
+	unsigned mask;
+	std::size_t n_batch;
+	Layout<vdim> v_layout;
+	std::array<std::size_t,vdim> v_offset; // of each axis in v and w
+	thrust::device_vector<val_type> v, w;
+	std::array<thrust::device_vector<val_type>,n_slot> _moment;
+
+	static std::array<std::size_t,vdim>
+	velocity_shape(const CoordinateSystem<val_type,dim>& coord) {
+		std::array<std::size_t,vdim> n;
+		for (std::size_t i=0; i<vdim; i++) n[i] = coord.nzTot[vdim+i];
+		return n;
+	}
+
+public:
+	MomentReducer(const CoordinateSystem<val_type,dim>& coord,
+								unsigned mask = moment::all)
+		: mask(mask), v_layout(velocity_shape(coord)) {
+
+		n_batch = 1;
+		for (std::size_t i=0; i<vdim; i++) n_batch *= coord.nzTot[i];
+
+		thrust::host_vector<val_type> _v, _w;
+		for (std::size_t i=0; i<vdim; i++) {
+			std::size_t nv = coord.nz[vdim+i], nBd = coord.nBd[vdim+i];
+			val_type C = coord.dz[vdim+i]/3.;
+			v_offset[i] = _v.size();
+			for (std::size_t j=0; j<coord.nzTot[vdim+i]; j++) {
+				_v.push_back(coord.coord[vdim+i][j]);
+				// ghost cells are not integrated
+				bool ghost = j<nBd || j>=nBd+nv;
+				_w.push_back(ghost? 0 : (j-nBd)%2==0? 2*C:4*C);
+			}
+		}
+		v = _v; w = _w;
+
+		for (std::size_t k=0; k<n_slot; k++)
+			if (mask & slot_moment(k)) _moment[k].resize(n_batch);
+	}
+
+	__host__ __device__
+	static constexpr unsigned slot_moment(std::size_t k) {
+		return k==0? moment::density : k<=vdim? moment::current :
+					 k==vdim+1? moment::energy : moment::heat_flux;
+	}
+
+	// the output arrays, one value per spatial point
+	const thrust::device_vector<val_type>& density() const { 
+		return _moment[0]; 
+	}
+	const thrust::device_vector<val_type>& current(std::size_t i) const {
+		return _moment[1+i];
+	}
+	const thrust::device_vector<val_type>& energy() const { 
+		return _moment[vdim+1]; 
+	}
+	const thrust::device_vector<val_type>& heat_flux(std::size_t i) const {
+		return _moment[vdim+2+i];
+	}
+
+	// values of f per spatial point
+	std::size_t segment() const { return v_layout.n_tot; }
+
+	// bytes read and written by one call
+	std::size_t bytes() const {
+		std::size_t n_out = 0;
+		for (std::size_t k=0; k<n_slot; k++) n_out += _moment[k].size();
+		return (n_batch*v_layout.n_tot+n_out)*sizeof(val_type);
+	}
+
+	template <typename itor_type>
+	void operator()(itor_type f_begin) { (*this)(f_begin,0,n_batch); }
+
+	// the spatial points [b0,b1) only, the others keep their values; in
+	// the v_inner layout their segments are the elements 
+	// [b0*n_seg,b1*n_seg) of f
+	template <typename itor_type>
+	void operator()(itor_type f_begin, std::size_t b0, std::size_t b1) {
+
+		std::array<val_type*,n_slot> out;
+		for (std::size_t k=0; k<n_slot; k++)
+			out[k] = thrust::raw_pointer_cast(_moment[k].data());
+
+		thrust::for_each(thrust::make_counting_iterator<std::size_t>(b0),
+										thrust::make_counting_iterator(b1),
+		[=,m=mask,nb=n_batch,vl=v_layout,off=v_offset,
+		 v_ptr=thrust::raw_pointer_cast(v.data()),
+		 w_ptr=thrust::raw_pointer_cast(w.data())](std::size_t b) {
+
+			std::size_t n_seg = vl.n_tot;
+			std::array<val_type,n_slot> acc{};
+
+			for (std::size_t s=0; s<n_seg; s++) {
+				auto idx_m = vl.idxS2M(s);
+				std::array<val_type,vdim> vz;
+				val_type weight = 1, v2 = 0;
+				for (std::size_t i=0; i<vdim; i++) {
+					vz[i] = v_ptr[off[i]+idx_m[i]];
+					weight *= w_ptr[off[i]+idx_m[i]];
+					v2 += vz[i]*vz[i];
+				}
+				val_type fw = weight*f_begin[v_inner? b*n_seg+s : s*nb+b];
+
+				if (m & moment::density) acc[0] += fw;
+				if (m & moment::current)
+					for (std::size_t i=0; i<vdim; i++) acc[1+i] += fw*vz[i];
+				if (m & moment::energy) acc[vdim+1] += fw*v2/2;
+				if (m & moment::heat_flux)
+					for (std::size_t i=0; i<vdim; i++) acc[vdim+2+i] += fw*vz[i]*v2/2;
+			}
+
+			for (std::size_t k=0; k<n_slot; k++)
+				if (m & slot_moment(k)) out[k][b] = acc[k];
+		});
+
+	}
+
+};
+
+} // namespace quakins
+
+#endif /* _MOMENT_REDUCER_HPP_ */
@@ -3,11 +3,13 @@
 
 #include "CoordinateSystem.hpp"
 #include "util.hpp"
+#include "Layout.hpp"
 
 namespace quakins {
 
 
-template <typename val_type, std::size_t dim>
+template <typename val_type, std::size_t dim,
+					typename layout_type = Layout<dim>>
 class PhaseSpaceInitialization {
 
 	CoordinateSystem<val_type,dim> *coord;
@@ -20,21 +22,20 @@ public:
 	template<typename Iterator, class DistFunc>
 	void operator()(Iterator itor_begin, DistFunc f) {
 		
-		auto n_dim = coord->nzTot;
+		layout_type layout(coord->nzTot);
 		auto range = coord->range;
 		auto dz = coord->dz;
-		int nTot = thrust::reduce(n_dim.begin(), n_dim.end(),1,
-																thrust::multiplies<std::size_t>());
+		std::size_t nTot = layout.n_tot;
 
-		auto trans_op = [f,n_dim,range,dz](int idx) {
-			auto idx_m = idxS2M(idx,n_dim);
+		auto trans_op = [f,layout,range,dz](std::size_t idx) {
+			auto idx_m = layout.idxS2M(idx);
 			std::array<val_type,dim> co;
 			for (std::size_t i=0; i<dim; i++)
 				co[i] = range[i*2] +idx_m[i]*dz[i];
 			return f(co);
 		};
 		auto titor = thrust::make_transform_iterator(
-									thrust::make_counting_iterator(0),trans_op);
+									thrust::make_counting_iterator<std::size_t>(0),trans_op);
 	
 		thrust::copy(titor,titor+nTot,itor_begin);
 
@@ -2,77 +2,146 @@
 #define _POISSON_SOLVER_1D_HPP_
 
 #include "util.hpp"
-#include <cufft.h>
-#include <thrust/functional.h>
+#include "FFTPlanCache.hpp"
+#include "BoundaryCondition.hpp"
+#include <thrust/for_each.h>
 #include <thrust/iterator/counting_iterator.h>
-#include <thrust/iterator/transform_iterator.h>
+#include <cmath>
+#include <cassert>
 
 namespace quakins {
 
 template <class T>
 class PoissonSolver1D : public CRTP<T,PoissonSolver1D<T>> {
-	
+
 public:
-	template <typename in_type,typename out_type,
-					  template<typename...> typename Container>
-	void operator()(const Container<in_type>& density, 
-									Container<out_type>& potential) { 
-		this->self().solve(in_begin, out_begin); 
+	template <typename in_container, typename out_container>
+	void operator()(const in_container& density,
+									out_container& potential) {
+		this->self().solve(density, potential);
 	}
 
 };
 
+/**
+ *  -phi'' = rho on a periodic domain of length L for n_batch independent
+ *  fields at once. Each field has n cells and nBd ghosts on both ends,
+ *  the fields are stored one after the other. The Green's function 1/k^2
+ *  (normalization of the inverse transform included) is computed once,
+ *  a solve is one batched forward and one batched inverse transform.
+ *  The ghosts of the potential are filled periodically.
+ */
 template <typename val_type,
 					template<typename...> typename Container>
-class FFTPoissonSolver1D 
+class FFTPoissonSolver1D
 : public PoissonSolver1D<FFTPoissonSolver1D<val_type,
 												Container>> {
 
-	cufftHandle plan_fwd, plan_inv;
-	Container<val_type> inv_k_square, buffer;
-	val_type L;
-	std::size_t n, nBd;
+	using complex_type = typename FFT<val_type,1>::complex_type;
+
+	std::size_t n, nBd, n_batch;
+	std::shared_ptr<FFT<val_type,1>> fft;
+	Container<val_type> inv_k_square;
+	Container<complex_type> buffer;
 
 public:
-	FFTPoissonSolver1D(std::size_t n, std::size_t nBd, val_type L)
-	: n(n), nBd(nBd), L(L) {
-		cufftCreate(&plan_fwd);
-		cufftCreate(&plan_inv);
-		cufftPlan1d(&plan_fwd,n,CUFFT_R2C,1);
-		cufftPlan1d(&plan_inv,n,CUFFT_C2R,1);
-	
-		inv_k_square.resize(n);
-		buffer.resize(n);
+	FFTPoissonSolver1D(std::size_t n, std::size_t nBd, val_type L,
+										 std::size_t n_batch = 1)
+	: n(n), nBd(nBd), n_batch(n_batch),
+		fft(fft_plan<val_type,1>({n},{n+2*nBd},n_batch)) {
+
+		std::size_t n_k = fft->complex_size();
+		thrust::host_vector<val_type> _inv_k_square(n_k);
+		val_type dk = 2.*M_PI/L;
+		for (std::size_t i=0; i<n_k; i++) {
+			val_type k = dk*static_cast<val_type>(i);
+			_inv_k_square[i] = i==0? 0. : 1./k/k/static_cast<val_type>(n);
+		}
+		inv_k_square = _inv_k_square;
+		buffer.resize(n_k*n_batch);
 	}
 
-	template <typename in_type, typename out_type>
-	void operator()(const Container<in_type>& dens, 
-									Container<out_type>& pot) { 
+	template <typename in_container, typename out_container>
+	void solve(const in_container& dens, out_container& pot) {
+
+		auto rho_ptr = thrust::raw_pointer_cast(dens.data())+nBd;
+		auto phi_ptr = thrust::raw_pointer_cast(pot.data())+nBd;
+		auto buf_ptr = thrust::raw_pointer_cast(buffer.data());
+		auto green_ptr = thrust::raw_pointer_cast(inv_k_square.data());
+		std::size_t n_k = fft->complex_size();
 
-		auto rho_ptr = (cufftReal*) thrust::raw_pointer_cast(dens.data()+nBd);
-		auto buf_ptr = (cufftComplex*) thrust::raw_pointer_cast(buffer.data());
-		auto phi_ptr = (cufftReal*) thrust::raw_pointer_cast(pot.data()+nBd);
-		
-		cufftExecR2C(plan_fwd,rho_ptr,buf_ptr);
+		fft->forward(rho_ptr,buf_ptr);
 
 		// k-space
-		int nint = static_cast<int>(n);
-		val_type dk = 2.*M_PI/L;
+		thrust::for_each(thrust::make_counting_iterator<std::size_t>(0),
+										thrust::make_counting_iterator(n_k*n_batch),
+		[=](std::size_t idx) { buf_ptr[idx] *= green_ptr[idx%n_k]; });
 
-		auto titor = thrust::make_transform_iterator(
-			thrust::make_counting_iterator(0),
-		[dk,nint](int idx) {
-			val_type k_value = dk*static_cast<val_type>
-														(idx<nint/2 ? idx:(idx-nint));
-			return idx==0? 0. :
-							1./k_value/k_value/static_cast<val_type>(nint);
-		});
+		fft->backward(buf_ptr,phi_ptr);
 
-		thrust::transform(titor,titor+n,buffer.begin(),
-											buffer.begin(),thrust::multiplies<val_type>());
-		
-		cufftExecC2R(plan_inv,buf_ptr,phi_ptr);
+		fill_periodic_ghosts<1>(pot.begin(),n_batch,{n},{nBd});
+	}
+
+};
 
+/**
+ *  -phi'' = rho with the second-order difference, for n_batch fields
+ *  laid out like in FFTPoissonSolver1D, on a bounded domain: the first
+ *  ghost on each side of pot holds the Dirichlet value there and the
+ *  ghosts are left as they are. The matrix is the same for every field,
+ *  so its Thomas factorization is made once and a solve is one forward
+ *  and one backward sweep per field, one thread per field.
+ */
+template <typename val_type,
+					template<typename...> typename Container>
+class ThomasPoissonSolver1D
+: public PoissonSolver1D<ThomasPoissonSolver1D<val_type,
+												Container>> {
+
+	std::size_t n, nBd, n_batch;
+	val_type h;
+	Container<val_type> inv_pivot; // 1/(2-1/(2-...)) of the LU factors
+
+public:
+	ThomasPoissonSolver1D(std::size_t n, std::size_t nBd, val_type L,
+												std::size_t n_batch = 1)
+	: n(n), nBd(nBd), n_batch(n_batch), h(L/static_cast<val_type>(n)) {
+
+		assert(nBd>=1);
+		thrust::host_vector<val_type> _inv_pivot(n);
+		_inv_pivot[0] = .5;
+		for (std::size_t i=1; i<n; i++)
+			_inv_pivot[i] = 1./(2.-_inv_pivot[i-1]);
+		inv_pivot = _inv_pivot;
+	}
+
+	template <typename in_container, typename out_container>
+	void solve(const in_container& dens, out_container& pot) {
+
+		auto rho_ptr = thrust::raw_pointer_cast(dens.data());
+		auto phi_ptr = thrust::raw_pointer_cast(pot.data());
+		auto m_ptr = thrust::raw_pointer_cast(inv_pivot.data());
+		std::size_t n_field = n+2*nBd, lo = nBd, hi = nBd+n;
+		val_type h2 = h*h;
+
+		thrust::for_each(thrust::make_counting_iterator<std::size_t>(0),
+										thrust::make_counting_iterator(n_batch),
+		[=](std::size_t b) {
+			auto rho = rho_ptr + b*n_field;
+			auto phi = phi_ptr + b*n_field;
+			// forward, the left wall value enters the first row
+			val_type d = phi[lo-1];
+			for (std::size_t i=lo; i<hi; i++) {
+				d = (h2*rho[i] + d)*m_ptr[i-lo];
+				phi[i] = d;
+			}
+			// backward, from the right wall value
+			val_type x = phi[hi];
+			for (std::size_t i=hi; i-->lo; ) {
+				x = phi[i] + m_ptr[i-lo]*x;
+				phi[i] = x;
+			}
+		});
 	}
 
 };
@@ -2,13 +2,319 @@
 #define _POISSON_SOLVER_2D_HPP_
 
 #include "util.hpp"
+#include "FFTPlanCache.hpp"
+#include "BoundaryCondition.hpp"
+#include <thrust/for_each.h>
+#include <thrust/iterator/counting_iterator.h>
+#include <thrust/transform_reduce.h>
+#include <thrust/functional.h>
+#include <array>
+#include <cmath>
+#include <vector>
+#include <cassert>
 
-class PoissonSolver2D : public CRTP<PoissonSolver2D> {
+namespace quakins {
 
+template <class T>
+class PoissonSolver2D : public CRTP<T,PoissonSolver2D<T>> {
 
+public:
+	template <typename in_container, typename out_container>
+	void operator()(const in_container& density,
+									out_container& potential) {
+		this->self().solve(density, potential);
+	}
 
 };
 
+/**
+ *  -(d^2/dx1^2 + d^2/dx2^2) phi = rho, periodic in x1 and x2, for n_batch
+ *  fields in the {x1,x2} layout of the CoordinateSystem, ghosts included
+ *  (the density of main_2d). Same as FFTPoissonSolver1D: the Green's
+ *  function is made once, a solve is one batched transform pair, and the
+ *  ghosts of the potential are filled periodically.
+ */
+template <typename val_type,
+					template<typename...> typename Container>
+class FFTPoissonSolver2D
+: public PoissonSolver2D<FFTPoissonSolver2D<val_type,
+												Container>> {
 
+	using complex_type = typename FFT<val_type,2>::complex_type;
+	using IntArray = std::array<std::size_t,2>;
+
+	IntArray n, nBd;
+	std::size_t n_batch;
+	std::shared_ptr<FFT<val_type,2>> fft;
+	Container<val_type> inv_k_square;
+	Container<complex_type> buffer;
+
+public:
+	FFTPoissonSolver2D(IntArray n, IntArray nBd, std::array<val_type,2> L,
+										 std::size_t n_batch = 1)
+	: n(n), nBd(nBd), n_batch(n_batch),
+		fft(fft_plan<val_type,2>(n,{n[0]+2*nBd[0],n[1]+2*nBd[1]},n_batch)) {
+
+		// the half spectrum is n[0]/2+1 by n[1], k1 varies fastest
+		std::size_t n_k1 = n[0]/2+1, n_k = fft->complex_size();
+		thrust::host_vector<val_type> _inv_k_square(n_k);
+		val_type dk1 = 2.*M_PI/L[0], dk2 = 2.*M_PI/L[1];
+		for (std::size_t i=0; i<n_k; i++) {
+			std::size_t i1 = i%n_k1, i2 = i/n_k1;
+			val_type k1 = dk1*static_cast<val_type>(i1);
+			val_type k2 = dk2*(i2<(n[1]+1)/2? static_cast<val_type>(i2)
+																			 : static_cast<val_type>(i2)-n[1]);
+			val_type k_square = k1*k1+k2*k2;
+			_inv_k_square[i] = i==0? 0. :
+				1./k_square/static_cast<val_type>(n[0]*n[1]);
+		}
+		inv_k_square = _inv_k_square;
+		buffer.resize(n_k*n_batch);
+	}
+
+	template <typename in_container, typename out_container>
+	void solve(const in_container& dens, out_container& pot) {
+
+		std::size_t offset = nBd[0] + nBd[1]*(n[0]+2*nBd[0]);
+		auto rho_ptr = thrust::raw_pointer_cast(dens.data())+offset;
+		auto phi_ptr = thrust::raw_pointer_cast(pot.data())+offset;
+		auto buf_ptr = thrust::raw_pointer_cast(buffer.data());
+		auto green_ptr = thrust::raw_pointer_cast(inv_k_square.data());
+		std::size_t n_k = fft->complex_size();
+
+		fft->forward(rho_ptr,buf_ptr);
+
+		// k-space
+		thrust::for_each(thrust::make_counting_iterator<std::size_t>(0),
+										thrust::make_counting_iterator(n_k*n_batch),
+		[=](std::size_t idx) { buf_ptr[idx] *= green_ptr[idx%n_k]; });
+
+		fft->backward(buf_ptr,phi_ptr);
+
+		fill_periodic_ghosts<2>(pot.begin(),n_batch,n,nBd);
+	}
+
+};
+
+// One multigrid level: cell I of an axis covers the fine cells I*p to
+// min((I+1)*p,nf)-1, so an odd count leaves a narrower last cell. The
+// walls sit on the centres of the fine ghosts, -1 and nf, and every 
+// level is a finite volume discretization with these walls. Only the
+// finest level is padded, its ghosts hold the Dirichlet values; the
+// coarser ones hold corrections and have homogeneous walls.
+template <typename val_type>
+struct MultigridLevel {
+
+	std::size_t n1, n2, nBd1, nBd2, n_field;
+	std::size_t p, nf1, nf2; // fine cells per cell, fine cells per axis
+	val_type h1, h2;         // fine spacing
+
+	__host__ __device__
+	std::size_t idx(std::size_t b, std::size_t i, std::size_t j) const {
+		return b*n_field + (j+nBd2)*(n1+2*nBd1) + i+nBd1;
+	}
+
+	// centre and width of cell I in fine cells
+	__host__ __device__
+	val_type center(std::size_t I, std::size_t nf) const {
+		std::size_t e = (I+1)*p<nf? (I+1)*p : nf;
+		return val_type(I*p+e-1)/2;
+	}
+	__host__ __device__
+	val_type width(std::size_t I, std::size_t nf) const {
+		std::size_t e = (I+1)*p<nf? (I+1)*p : nf;
+		return val_type(e-I*p);
+	}
+
+	// coupling to the left and to the right neighbour (or wall) along
+	// one axis of n cells
+	__host__ __device__
+	void coupling(std::size_t I, std::size_t n, std::size_t nf, val_type h,
+								val_type& c_l, val_type& c_r) const {
+		val_type c = center(I,nf), w = width(I,nf)*h*h;
+		val_type l = I>0? center(I-1,nf) : val_type(-1);
+		val_type r = I+1<n? center(I+1,nf) : val_type(nf);
+		c_l = 1/((c-l)*w); c_r = 1/((r-c)*w);
+	}
+
+	// the off-diagonal part and the diagonal of -laplace(u) at (i,j)
+	__host__ __device__
+	void stencil(const val_type* u, std::size_t b, std::size_t i,
+							 std::size_t j, val_type& off, val_type& diag) const {
+		std::size_t k = idx(b,i,j), s2 = n1+2*nBd1;
+		bool padded = nBd1>0;
+		val_type c1l, c1r, c2l, c2r;
+		coupling(i,n1,nf1,h1,c1l,c1r);
+		coupling(j,n2,nf2,h2,c2l,c2r);
+		diag = c1l+c1r+c2l+c2r;
+		off = 0;
+		if (padded || i>0)    off += c1l*u[k-1];
+		if (padded || i+1<n1) off += c1r*u[k+1];
+		if (padded || j>0)    off += c2l*u[k-s2];
+		if (padded || j+1<n2) off += c2r*u[k+s2];
+	}
+
+};
+
+/**
+ *  -(d^2/dx1^2 + d^2/dx2^2) phi = rho on a bounded domain, for n_batch
+ *  fields laid out like in FFTPoissonSolver2D: the first ghost ring of
+ *  pot holds the Dirichlet values and is left as it is. Geometric
+ *  multigrid with red-black Gauss-Seidel smoothing, the levels halve
+ *  the grid (ceil(n/2)) until it is a few cells wide. V-cycles run until
+ *  the residual is below tol times the size of the terms of the 
+ *  equation; pot is the initial guess, the last solution is a good one.
+ */
+template <typename val_type,
+					template<typename...> typename Container>
+class MultigridPoissonSolver2D
+: public PoissonSolver2D<MultigridPoissonSolver2D<val_type,
+												Container>> {
+
+	using IntArray = std::array<std::size_t,2>;
+
+	std::size_t n_batch, n_pre = 2, n_post = 2, n_coarsest = 40;
+	std::vector<MultigridLevel<val_type>> level;
+	std::vector<Container<val_type>> u, f, r; // u, f of level 0 are pot, dens
+	std::size_t _n_cycle = 0;
+
+public:
+	val_type tol;
+	std::size_t max_cycle = 50;
+
+	MultigridPoissonSolver2D(IntArray n, IntArray nBd, 
+													 std::array<val_type,2> L, std::size_t n_batch = 1,
+													 val_type tol = std::is_same_v<val_type,float>? 1e-6:1e-12)
+	: n_batch(n_batch), tol(tol) {
+
+		assert(nBd[0]>=1 && nBd[1]>=1);
+		MultigridLevel<val_type> lv{n[0],n[1],nBd[0],nBd[1],
+			(n[0]+2*nBd[0])*(n[1]+2*nBd[1]), 1, n[0], n[1], L[0]/n[0], L[1]/n[1]};
+		level.push_back(lv);
+		while (lv.n1>2 || lv.n2>2) {
+			lv.n1 = (lv.n1+1)/2; lv.n2 = (lv.n2+1)/2; lv.p *= 2;
+			lv.nBd1 = lv.nBd2 = 0; lv.n_field = lv.n1*lv.n2;
+			level.push_back(lv);
+		}
+		u.resize(level.size()); f.resize(level.size()); r.resize(level.size());
+		for (std::size_t l=0; l<level.size(); l++) {
+			std::size_t size = n_batch*level[l].n1*level[l].n2;
+			if (l>0) { u[l].resize(size); f[l].resize(size); }
+			r[l].resize(size);
+		}
+	}
+
+	// V-cycles of the last solve
+	std::size_t n_cycle() const { return _n_cycle; }
+
+	template <typename in_container, typename out_container>
+	void solve(const in_container& dens, out_container& pot) {
+
+		auto u0 = thrust::raw_pointer_cast(pot.data());
+		auto f0 = thrust::raw_pointer_cast(dens.data());
+
+		val_type f_max = max_abs(f0), diag = 2/level[0].h1/level[0].h1
+																			+ 2/level[0].h2/level[0].h2;
+
+		// relative to both terms of -laplace(u) = f, float rounding alone
+		// gives a residual of about eps*diag*|u|
+		for (_n_cycle=0; _n_cycle<max_cycle; ) {
+			cycle(0,u0,f0);
+			_n_cycle++;
+			residual(0,u0,f0);
+			val_type r_max = thrust::transform_reduce(r[0].begin(),r[0].end(),
+				[](val_type v) { return v<0? -v:v; }, 
+				val_type(0), thrust::maximum<val_type>());
+			if (r_max <= tol*(f_max+diag*max_abs(u0))) break;
+		}
+	}
+
+private:
+	// over the interior of the finest level
+	val_type max_abs(const val_type* v) {
+		auto lv = level[0];
+		return thrust::transform_reduce(
+			thrust::make_counting_iterator<std::size_t>(0),
+			thrust::make_counting_iterator(n_batch*lv.n1*lv.n2),
+			[=](std::size_t t) { 
+				val_type a = v[lv.idx(t/lv.n1/lv.n2,t%lv.n1,t/lv.n1%lv.n2)];
+				return a<0? -a:a; }, val_type(0), thrust::maximum<val_type>());
+	}
+
+	template <typename Func>
+	void for_each_cell(std::size_t l, Func func) {
+		auto lv = level[l];
+		thrust::for_each(thrust::make_counting_iterator<std::size_t>(0),
+										thrust::make_counting_iterator(n_batch*lv.n1*lv.n2),
+		[=](std::size_t t) {
+			func(t/lv.n1/lv.n2, t%lv.n1, t/lv.n1%lv.n2);
+		});
+	}
+
+	void smooth(std::size_t l, val_type* u, const val_type* f) {
+		auto lv = level[l];
+		for (std::size_t color=0; color<2; color++)
+			for_each_cell(l,[=](std::size_t b, std::size_t i, std::size_t j) {
+				if ((i+j)%2!=color) return;
+				val_type off, diag;
+				lv.stencil(u,b,i,j,off,diag);
+				std::size_t k = lv.idx(b,i,j);
+				u[k] = (f[k]+off)/diag;
+			});
+	}
+
+	// r = f + laplace(u), unpadded
+	void residual(std::size_t l, const val_type* u, const val_type* f) {
+		auto lv = level[l];
+		auto r_ptr = thrust::raw_pointer_cast(r[l].data());
+		for_each_cell(l,[=](std::size_t b, std::size_t i, std::size_t j) {
+			val_type off, diag;
+			lv.stencil(u,b,i,j,off,diag);
+			std::size_t k = lv.idx(b,i,j);
+			r_ptr[(b*lv.n2+j)*lv.n1+i] = f[k] - (diag*u[k]-off);
+		});
+	}
+
+	void cycle(std::size_t l, val_type* u_l, const val_type* f_l) {
+
+		if (l+1==level.size()) {
+			for (std::size_t i=0; i<n_coarsest; i++) smooth(l,u_l,f_l);
+			return;
+		}
+		for (std::size_t i=0; i<n_pre; i++) smooth(l,u_l,f_l);
+		residual(l,u_l,f_l);
+
+		// the coarse right hand side is the residual averaged over the
+		// fine cells it covers
+		auto fine = level[l], coarse = level[l+1];
+		auto r_ptr = thrust::raw_pointer_cast(r[l].data());
+		auto u_c = thrust::raw_pointer_cast(u[l+1].data());
+		auto f_c = thrust::raw_pointer_cast(f[l+1].data());
+		for_each_cell(l+1,[=](std::size_t b, std::size_t i, std::size_t j) {
+			val_type sum = 0, area = 0;
+			for (std::size_t jj=2*j; jj<2*j+2 && jj<fine.n2; jj++)
+				for (std::size_t ii=2*i; ii<2*i+2 && ii<fine.n1; ii++) {
+					val_type a = fine.width(ii,fine.nf1)*fine.width(jj,fine.nf2);
+					sum += a*r_ptr[(b*fine.n2+jj)*fine.n1+ii];
+					area += a;
+				}
+			std::size_t k = coarse.idx(b,i,j);
+			f_c[k] = sum/area;
+			u_c[k] = 0;
+		});
+
+		cycle(l+1,u_c,f_c);
+
+		// piecewise constant correction
+		for_each_cell(l,[=](std::size_t b, std::size_t i, std::size_t j) {
+			u_l[fine.idx(b,i,j)] += u_c[coarse.idx(b,i/2,j/2)];
+		});
+
+		for (std::size_t i=0; i<n_post; i++) smooth(l,u_l,f_l);
+	}
+
+};
+
+} // namespace quakins
 
 #endif /* _POISSON_SOLVER_2D_HPP_ */
@@ -0,0 +1,210 @@
+#ifndef _PROFILER_HPP_
+#define _PROFILER_HPP_
+
+#include "Backend.hpp"
+#include <chrono>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace quakins {
+
+/**
+ *  Named, nested timing regions, summed per path ("step/Poisson") over
+ *  the run: total time, number of calls and bytes moved. Off unless the
+ *  environment variable QUAKINS_PROFILE names an output file, .csv for
+ *  CSV, anything else for JSON; it is written by write() or at exit.
+ *
+ *  thrust calls return before the device is done, so the wall time of a
+ *  region is only meaningful with QUAKINS_PROFILE_MODE set to
+ *    sync   the device is synchronized when a region begins and ends,
+ *    event  a pair of CUDA events brackets the region and is read later,
+ *           which leaves the work asynchronous (device backend only),
+ *    wall   the host time, the default.
+ */
+class Profiler {
+
+public:
+	enum class Mode { wall, sync, event };
+
+	struct Stat {
+		double total_ms = 0;
+		std::size_t count = 0, bytes = 0;
+	};
+
+private:
+	using clock = std::chrono::steady_clock;
+
+	bool enabled = false, written = false;
+	Mode mode = Mode::wall;
+	std::string out_path;
+	std::vector<std::string> stack;
+	std::map<std::string,Stat> stats;
+
+#ifndef QUAKINS_HOST
+	struct Pending { std::string path; cudaEvent_t start, stop; };
+	std::deque<Pending> pending;
+	std::vector<cudaEvent_t> events; // free ones
+
+	cudaEvent_t event() {
+		cudaEvent_t e;
+		if (events.empty()) cudaEventCreate(&e);
+		else { e = events.back(); events.pop_back(); }
+		return e;
+	}
+
+	// the oldest event pairs, keeping at most n unread
+	void resolve(std::size_t n = 0) {
+		while (pending.size()>n) {
+			auto& p = pending.front();
+			float ms = 0;
+			cudaEventSynchronize(p.stop);
+			cudaEventElapsedTime(&ms,p.start,p.stop);
+			stats[p.path].total_ms += ms;
+			events.push_back(p.start); events.push_back(p.stop);
+			pending.pop_front();
+		}
+	}
+#endif
+
+	Profiler() {
+		if (auto path = std::getenv("QUAKINS_PROFILE")) {
+			enabled = true; out_path = path;
+		}
+		if (auto m = std::getenv("QUAKINS_PROFILE_MODE")) {
+			std::string s(m);
+			mode = s=="sync"? Mode::sync : s=="event"? Mode::event : Mode::wall;
+		}
+#ifdef QUAKINS_HOST
+		// the host backend runs synchronously anyway
+		mode = Mode::wall;
+#endif
+	}
+
+	// the events may not be readable any more this late, call write()
+	// before the end of main
+	~Profiler() { if (enabled && !written) write(); }
+
+	std::string path_of(const std::string& name) const {
+		std::string path;
+		for (auto& s : stack) path += s+"/";
+		return path+name;
+	}
+
+public:
+	Profiler(const Profiler&) = delete;
+	Profiler& operator=(const Profiler&) = delete;
+
+	static Profiler& instance() {
+		static Profiler profiler;
+		return profiler;
+	}
+
+	// what the environment does, for programs that set it themselves
+	void enable(std::string path, Mode m = Mode::wall) {
+		enabled = true; out_path = path; mode = m;
+#ifdef QUAKINS_HOST
+		mode = Mode::wall;
+#endif
+	}
+	bool is_enabled() const { return enabled; }
+
+	/// a region lasts as long as this object
+	class Region {
+		Profiler* prof;
+		std::string path;
+		clock::time_point t0;
+#ifndef QUAKINS_HOST
+		cudaEvent_t start;
+#endif
+	public:
+		Region(Profiler* prof, std::string name, std::size_t bytes)
+		: prof(prof->enabled? prof : nullptr) {
+			if (!this->prof) return;
+			path = prof->path_of(name);
+			prof->stack.push_back(name);
+			auto& stat = prof->stats[path];
+			stat.count++; stat.bytes += bytes;
+			if (prof->mode==Mode::sync) backend::synchronize();
+#ifndef QUAKINS_HOST
+			if (prof->mode==Mode::event) {
+				start = prof->event(); cudaEventRecord(start);
+				return;
+			}
+#endif
+			t0 = clock::now();
+		}
+		Region(const Region&) = delete;
+		Region& operator=(const Region&) = delete;
+
+		~Region() {
+			if (!prof) return;
+			prof->stack.pop_back();
+#ifndef QUAKINS_HOST
+			if (prof->mode==Mode::event) {
+				auto stop = prof->event(); cudaEventRecord(stop);
+				prof->pending.push_back({path,start,stop});
+				prof->resolve(1024);
+				return;
+			}
+#endif
+			if (prof->mode==Mode::sync) backend::synchronize();
+			prof->stats[path].total_ms += std::chrono::duration<double,
+				std::milli>(clock::now()-t0).count();
+		}
+	};
+
+	// bytes: what the region reads and writes, for a bandwidth
+	Region region(std::string name, std::size_t bytes = 0) {
+		return Region(this,name,bytes);
+	}
+
+	const std::map<std::string,Stat>& results() {
+#ifndef QUAKINS_HOST
+		resolve();
+#endif
+		return stats;
+	}
+
+	void write_csv(std::ostream& os) {
+		os << "region,count,total_ms,mean_ms,bytes,GB/s\n";
+		for (auto& [path,s] : results())
+			os << path << "," << s.count << "," << s.total_ms << ","
+				 << s.total_ms/s.count << "," << s.bytes << ","
+				 << (s.total_ms>0? s.bytes/s.total_ms*1e-6 : 0.) << "\n";
+	}
+
+	void write_json(std::ostream& os) {
+		const char* mode_name[] = {"wall","sync","event"};
+		os << "{\n  \"mode\": \"" << mode_name[static_cast<int>(mode)]
+			 << "\",\n  \"regions\": [";
+		bool first = true;
+		for (auto& [path,s] : results()) {
+			os << (first? "\n" : ",\n") << "    {\"region\": \"" << path
+				 << "\", \"count\": " << s.count << ", \"total_ms\": " << s.total_ms
+				 << ", \"bytes\": " << s.bytes << "}";
+			first = false;
+		}
+		os << "\n  ]\n}\n";
+	}
+
+	// to the file named by QUAKINS_PROFILE or enable()
+	void write() {
+		if (!enabled) return;
+		std::ofstream os(out_path);
+		if (out_path.size()>=4 && out_path.substr(out_path.size()-4)==".csv")
+			write_csv(os);
+		else write_json(os);
+		if (!os) std::cerr << "cannot write " << out_path << std::endl;
+		written = true;
+	}
+
+};
+
+} // namespace quakins
+
+#endif /* _PROFILER_HPP_ */
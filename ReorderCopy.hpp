@@ -4,46 +4,48 @@
 #include <thrust/iterator/permutation_iterator.h>
 #include <thrust/scan.h>
 #include <thrust/inner_product.h>
+#include <thrust/iterator/transform_iterator.h>
+#include <thrust/iterator/counting_iterator.h>
 #include "WignerFunction.hpp"
 #include "util.hpp"
+#include "Layout.hpp"
 
 namespace quakins {
 	
 	template<std::size_t dim,bool piter_on_origin>
 	struct cal_permutation_index {
 	
-		const std::array<std::size_t, dim> order, n_dim;
-	  std::array<std::size_t,dim> n_dim_new;
+		// the gather (piter_on_origin) walks the new array and points into 
+		// the original one, the scatter the other way around
+		Layout<dim> src_layout;
+		std::array<std::size_t,dim> dst_stride; // per axis of the source 
 
 		cal_permutation_index(std::array<std::size_t,dim> order,
-										std::array<std::size_t,dim> n_dim):
-					order(order), n_dim(n_dim) { 
+										std::array<std::size_t,dim> n_dim) 
+			: src_layout(n_dim) { 
 					
+			std::array<std::size_t,dim> n_dim_new;
 			auto p_iter_n = thrust::make_permutation_iterator
 							(n_dim.begin(),order.begin());
 			thrust::copy(p_iter_n,p_iter_n+dim,n_dim_new.begin());
-						
-		}
-
-		std::size_t operator()(std::size_t idx) {
-
-			std::array<std::size_t,dim> idx_m_new;
-		
-			// take n_dim_new here
-			std::array<std::size_t,dim> idx_m = 
-					idxS2M(idx,piter_on_origin ? n_dim_new:n_dim);
 
-			auto p_iter = thrust::make_permutation_iterator
-							(idx_m.begin(),order.begin());
-			thrust::copy(p_iter,p_iter+dim,idx_m_new.begin());
-	
-			// take n_dim here, if it is the other way arround, 
-			// the permuation_iterator shall point to the new array 
-			// instead of the original one as is in this case
-			return idxM2S(idx_m_new,piter_on_origin? n_dim:n_dim_new);
+			Layout<dim> layout(n_dim), layout_new(n_dim_new);
+			if constexpr (piter_on_origin) src_layout = layout_new;
 
+			// idx_m_new[k] = idx_m[order[k]]
+			for (std::size_t k=0; k<dim; k++)
+				dst_stride[order[k]] = piter_on_origin? 
+						layout.stride[k] : layout_new.stride[k];
 		}
 
+		__host__ __device__
+		std::size_t operator()(std::size_t idx) const {
+			auto idx_m = src_layout.idxS2M(idx);
+			std::size_t idx_s = 0;
+			for (std::size_t i=0; i<dim; i++)
+				idx_s += idx_m[i]*dst_stride[i];
+			return idx_s;
+		}
 
 	};
 
@@ -84,6 +86,11 @@ namespace quakins {
 
 		}
 
+		// bytes held by the permutation
+		std::size_t memory_footprint() const { 
+			return p_idx.size()*sizeof(std::size_t); 
+		}
+
 		template<typename OutputItor, typename InputItor>
 		void operator()(InputItor inBegin, OutputItor outBegin) {
 			if constexpr(piter_on_origin) {
@@ -99,6 +106,77 @@ namespace quakins {
 	
 	};
 
+
+	// Same as ReorderCopy, but the permutation is generated on the fly:
+	// the destination offset of each source axis is tabulated, so only
+	// n_0+n_1+... indices are stored instead of n_0*n_1*...
+	template <typename val_type, 
+					 	std::size_t dim,
+						bool piter_on_origin,
+						template<typename...> typename Container 
+					 >
+#if __cplusplus > 201703L
+	requires Iteratable<Container<val_type>>
+#endif
+	class CompactReorderCopy {
+	
+		std::size_t n_tot;
+		Layout<dim> src_layout;
+		std::array<std::size_t,dim> table_begin;
+		Container<std::size_t> axis_offset;
+
+	public:
+		CompactReorderCopy(std::array<std::size_t,dim> n_dim, 
+											 std::array<std::size_t,dim> order)
+			: src_layout(n_dim) {
+
+			cal_permutation_index<dim, piter_on_origin> op(order,n_dim);
+			src_layout = op.src_layout;
+			n_tot = src_layout.n_tot;
+
+			thrust::host_vector<std::size_t> _axis_offset;
+			for (std::size_t i=0; i<dim; i++) {
+				table_begin[i] = _axis_offset.size();
+				for (std::size_t t=0; t<src_layout.n[i]; t++)
+					_axis_offset.push_back(t*op.dst_stride[i]);
+			}
+			axis_offset = _axis_offset;
+
+		}
+
+		// bytes held by the permutation
+		std::size_t memory_footprint() const { 
+			return axis_offset.size()*sizeof(std::size_t); 
+		}
+
+		template<typename OutputItor, typename InputItor>
+		void operator()(InputItor inBegin, OutputItor outBegin) {
+
+			auto titor = thrust::make_transform_iterator(
+				thrust::make_counting_iterator<std::size_t>(0),
+				[l_layout=src_layout, l_table_begin=table_begin,
+				 offset_ptr=thrust::raw_pointer_cast(axis_offset.data())]
+				(std::size_t idx) {
+					auto idx_m = l_layout.idxS2M(idx);
+					std::size_t idx_s = 0;
+					for (std::size_t i=0; i<dim; i++)
+						idx_s += offset_ptr[l_table_begin[i]+idx_m[i]];
+					return idx_s;
+				});
+
+			if constexpr(piter_on_origin) {
+				auto permutationItor = thrust::make_permutation_iterator(
+											inBegin,titor);
+				thrust::copy(permutationItor, permutationItor+n_tot, outBegin);
+			} else {
+				auto permutationItor = thrust::make_permutation_iterator(
+											outBegin,titor);
+				thrust::copy(inBegin,inBegin+n_tot,permutationItor);
+			}
+		}
+	
+	};
+
 }
 
 
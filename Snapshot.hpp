@@ -0,0 +1,288 @@
+#ifndef _SNAPSHOT_HPP_
+#define _SNAPSHOT_HPP_
+
+#include "CoordinateSystem.hpp"
+#include "Backend.hpp"
+#include <thrust/copy.h>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <array>
+#include <map>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace quakins {
+
+/**
+ *  Binary snapshots. A file name.qks holds any number of records, one
+ *  after the other, each a header and the raw values (native byte order):
+ *
+ *    char[8]  "QKSNAP\0\0"
+ *    u32      version, bytes per value, number of axes
+ *    u64      step
+ *    f64      time
+ *    u32      length of the name, then the name
+ *    per axis, fastest varying first (the layout order):
+ *      u32      axis of the CoordinateSystem
+ *      u64      nz, nBd
+ *      f64      lower and upper end of the range
+ *      f64[nz+2nBd] the coordinates, ghosts included
+ *    u64      number of values, then the values
+ */
+struct SnapshotAxis {
+	std::uint32_t id;
+	std::uint64_t nz, nBd;
+	double lo, hi;
+	std::vector<double> coord;
+};
+
+struct SnapshotHeader {
+
+	static constexpr char magic[8] = {'Q','K','S','N','A','P',0,0};
+	static constexpr std::uint32_t version = 1;
+
+	std::uint32_t val_size = 0;
+	std::uint64_t step = 0;
+	double time = 0;
+	std::string name;
+	std::vector<SnapshotAxis> axes;
+
+	std::uint64_t n_value() const {
+		std::uint64_t n = 1;
+		for (auto& axis : axes) n *= axis.nz+2*axis.nBd;
+		return n;
+	}
+
+	// the axes of coord listed in order, fastest first
+	template <typename val_type, std::size_t dim>
+	static SnapshotHeader make(std::string name,
+														 const CoordinateSystem<val_type,dim>& coord,
+														 const std::vector<std::size_t>& order,
+														 std::size_t step, double time) {
+		SnapshotHeader h;
+		h.val_size = sizeof(val_type); h.step = step; h.time = time;
+		h.name = name;
+		for (auto i : order) {
+			SnapshotAxis axis{static_cast<std::uint32_t>(i),coord.nz[i],coord.nBd[i],
+												coord.range[2*i],coord.range[2*i+1],{}};
+			axis.coord.assign(coord.coord[i].begin(),coord.coord[i].end());
+			h.axes.push_back(std::move(axis));
+		}
+		return h;
+	}
+
+	void write(std::ostream& os) const {
+		auto put = [&](auto v) { os.write(reinterpret_cast<const char*>(&v),sizeof(v)); };
+		os.write(magic,8);
+		put(version); put(val_size); put(static_cast<std::uint32_t>(axes.size()));
+		put(step); put(time);
+		put(static_cast<std::uint32_t>(name.size())); os.write(name.data(),name.size());
+		for (auto& axis : axes) {
+			put(axis.id); put(axis.nz); put(axis.nBd); put(axis.lo); put(axis.hi);
+			os.write(reinterpret_cast<const char*>(axis.coord.data()),
+							 axis.coord.size()*sizeof(double));
+		}
+		put(n_value());
+	}
+
+	// false at the end of the file or on a record that is not a snapshot;
+	// the stream is left at the values
+	bool read(std::istream& is) {
+		auto get = [&](auto& v) { is.read(reinterpret_cast<char*>(&v),sizeof(v)); };
+		char m[8]; std::uint32_t ver, n_axis, n_name; std::uint64_t n;
+		if (!is.read(m,8) || std::memcmp(m,magic,8)!=0) return false;
+		get(ver); get(val_size); get(n_axis); get(step); get(time); get(n_name);
+		if (ver!=version) return false;
+		name.resize(n_name); is.read(name.data(),n_name);
+		axes.resize(n_axis);
+		for (auto& axis : axes) {
+			get(axis.id); get(axis.nz); get(axis.nBd); get(axis.lo); get(axis.hi);
+			axis.coord.resize(axis.nz+2*axis.nBd);
+			is.read(reinterpret_cast<char*>(axis.coord.data()),
+							axis.coord.size()*sizeof(double));
+		}
+		get(n);
+		return static_cast<bool>(is) && n==n_value();
+	}
+
+};
+
+/**
+ *  Writes snapshots from a background thread. write() copies the values
+ *  into one of two staging buffers (page-locked on the device backend)
+ *  and returns, the thread appends the record to its file; a write only
+ *  waits when both buffers are still being written out. The files are
+ *  complete once flush() returns or the writer is destroyed.
+ */
+class SnapshotWriter {
+
+	struct Slot {
+		char* ptr = nullptr;
+		std::size_t capacity = 0;
+		bool busy = false;
+	};
+
+	struct Job {
+		std::size_t slot;
+		SnapshotHeader header;
+		std::size_t bytes;
+		std::string path, preamble;
+		bool replace; // the whole file, else appended
+	};
+
+	std::string dir;
+	bool append; // to the files of an earlier run, else they start anew
+	std::array<Slot,2> slots;
+	std::deque<Job> jobs;
+	std::map<std::string,std::ofstream> files;
+	std::mutex mtx;
+	std::condition_variable cv;
+	bool stop = false;
+	std::thread worker;
+
+	static char* allocate(std::size_t bytes) {
+		return static_cast<char*>(backend::allocate_pinned(bytes));
+	}
+
+	static void deallocate(char* ptr) { backend::free_pinned(ptr); }
+
+	// what is written to path, a file or a directory, on the disk
+	static bool sync(const std::string& path) {
+		int fd = ::open(path.c_str(),O_RDONLY);
+		if (fd<0) return false;
+		bool ok = ::fsync(fd)==0;
+		return ::close(fd)==0 && ok;
+	}
+
+	void run() {
+		std::unique_lock<std::mutex> lock(mtx);
+		while (true) {
+			cv.wait(lock,[&]{ return stop || !jobs.empty(); });
+			if (jobs.empty()) return;
+			Job job = std::move(jobs.front()); jobs.pop_front();
+			lock.unlock();
+
+			// only this thread touches the files
+			if (job.replace) {
+				// through a temporary, the old file stays until the new is whole
+				std::string tmp = job.path+".tmp";
+				std::ofstream os(tmp,std::ios::out|std::ios::binary|std::ios::trunc);
+				os.write(job.preamble.data(),job.preamble.size());
+				job.header.write(os);
+				os.write(slots[job.slot].ptr,job.bytes);
+				os.close();
+				// the data before the rename, the rename before the next one
+				auto slash = job.path.rfind('/');
+				std::string parent = slash==std::string::npos? "." : 
+														 job.path.substr(0,slash+1);
+				if (!os || !sync(tmp) 
+								|| std::rename(tmp.c_str(),job.path.c_str())!=0 
+								|| !sync(parent))
+					std::cerr << "cannot write " << job.path << std::endl;
+			} else {
+				auto& os = files[job.path];
+				if (!os.is_open())
+					os.open(job.path,std::ios::out|std::ios::binary|
+									(append? std::ios::app : std::ios::trunc));
+				job.header.write(os);
+				os.write(slots[job.slot].ptr,job.bytes);
+				os.flush();
+				if (!os) std::cerr << "cannot write " << job.path << std::endl;
+			}
+
+			lock.lock();
+			slots[job.slot].busy = false;
+			cv.notify_all();
+		}
+	}
+
+	template <typename val_type, typename itor_type>
+	void submit(itor_type itor_begin, SnapshotHeader header, 
+							std::string path, std::string preamble, bool replace) {
+
+		std::size_t n = header.n_value(), bytes = n*sizeof(val_type);
+
+		std::size_t s;
+		{
+			std::unique_lock<std::mutex> lock(mtx);
+			cv.wait(lock,[&]{ return !slots[0].busy || !slots[1].busy; });
+			s = slots[0].busy? 1 : 0;
+			slots[s].busy = true;
+		}
+		auto& slot = slots[s];
+		if (slot.capacity<bytes) {
+			if (slot.ptr) deallocate(slot.ptr);
+			slot.ptr = allocate(bytes);
+			slot.capacity = bytes;
+		}
+		thrust::copy(itor_begin,itor_begin+n,
+								 reinterpret_cast<val_type*>(slot.ptr));
+
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			jobs.push_back({s,std::move(header),bytes,
+											std::move(path),std::move(preamble),replace});
+		}
+		cv.notify_all();
+	}
+
+public:
+	// append for a run that continues an earlier one, a restart
+	SnapshotWriter(std::string dir = ".", bool append = false)
+	: dir(dir), append(append), worker(&SnapshotWriter::run,this) {}
+
+	SnapshotWriter(const SnapshotWriter&) = delete;
+	SnapshotWriter& operator=(const SnapshotWriter&) = delete;
+
+	~SnapshotWriter() {
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			stop = true;
+		}
+		cv.notify_all();
+		worker.join();
+		for (auto& slot : slots) if (slot.ptr) deallocate(slot.ptr);
+	}
+
+	// appends the values at itor_begin, laid out as the axes of coord
+	// in order, to name.qks; the first write of a writer that does not
+	// append truncates the file
+	template <typename itor_type, typename val_type, std::size_t dim>
+	void write(std::string name, itor_type itor_begin,
+						 const CoordinateSystem<val_type,dim>& coord,
+						 const std::vector<std::size_t>& order,
+						 std::size_t step = 0, double time = 0) {
+		submit<val_type>(itor_begin,
+			SnapshotHeader::make(name,coord,order,step,time),
+			dir+"/"+name+".qks","",false);
+	}
+
+	// writes path anew: preamble, then the record of header and the 
+	// values at itor_begin; a crash while writing leaves the old file
+	template <typename val_type, typename itor_type>
+	void write_file(std::string path, std::string preamble,
+									SnapshotHeader header, itor_type itor_begin) {
+		submit<val_type>(itor_begin,std::move(header),path,preamble,true);
+	}
+
+	// waits until everything written so far is in the files
+	void flush() {
+		std::unique_lock<std::mutex> lock(mtx);
+		cv.wait(lock,[&]{
+			return jobs.empty() && !slots[0].busy && !slots[1].busy; });
+	}
+
+};
+
+} // namespace quakins
+
+#endif /* _SNAPSHOT_HPP_ */
@@ -0,0 +1,165 @@
+#ifndef _TILED_REORDER_COPY_HPP_
+#define _TILED_REORDER_COPY_HPP_
+
+#include <thrust/for_each.h>
+#include <thrust/iterator/counting_iterator.h>
+#include <thrust/type_traits/is_contiguous_iterator.h>
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <type_traits>
+
+namespace quakins {
+
+#ifdef __CUDACC__
+// one block per tile, the blocks striding over all n_tile tiles
+template <typename copy_type, typename val_type>
+__global__ void tiled_reorder_kernel(copy_type copy, const val_type* in,
+																		 val_type* out, std::size_t n_tile) {
+	for (std::size_t t=blockIdx.x; t<n_tile; t+=gridDim.x)
+		copy.copy_tile(in,out,t);
+}
+#endif
+
+/**
+ *  Permutes the axes of a dim-dimensional array like MemSaveReorderCopy:
+ *  axis k of the output is axis order[k] of the input. The output is
+ *  walked tile by tile in the plane spanned by the fastest output axis
+ *  and the output axis holding the fastest input axis. All strides are 
+ *  computed once here.
+ *
+ *  On the device a tile is staged in shared memory by a block of its 
+ *  own, read along the input's contiguous axis and written along the
+ *  output's, so that both the loads and the stores coalesce. Elsewhere,
+ *  and for iterators that are not plain device memory, consecutive 
+ *  threads write consecutive elements and read in_s0 apart, relying on
+ *  the caches for the reuse of a tile's lines.
+ */
+template <typename val_type, std::size_t dim, std::size_t tile = 32>
+class TiledReorderCopy {
+
+	static_assert(dim>=2 && dim<=6, "TiledReorderCopy handles 2 to 6 axes");
+
+	using IntArray = std::array<std::size_t,dim>;
+
+	std::size_t n_tot, k_tile;          // the 2nd tiled output axis
+	std::size_t n0, n1, n_tile0, n_tile1;
+	std::size_t out_s0, out_s1, in_s0, in_s1;
+
+	// sizes and strides of the remaining dim-2 output axes
+	std::array<std::size_t,dim-2> rest_n, rest_out_s, rest_in_s;
+
+public:
+	TiledReorderCopy(IntArray order, IntArray n_dim) {
+
+		IntArray in_stride, out_n, out_stride;
+		in_stride[0] = 1;
+		for (std::size_t i=1; i<dim; i++)
+			in_stride[i] = in_stride[i-1]*n_dim[i-1];
+
+		for (std::size_t k=0; k<dim; k++) out_n[k] = n_dim[order[k]];
+		out_stride[0] = 1;
+		for (std::size_t k=1; k<dim; k++)
+			out_stride[k] = out_stride[k-1]*out_n[k-1];
+		n_tot = out_stride[dim-1]*out_n[dim-1];
+
+		// the output axis that is contiguous in the input
+		k_tile = 1;
+		for (std::size_t k=1; k<dim; k++)
+			if (order[k]==0) k_tile = k;
+
+		n0 = out_n[0];      n1 = out_n[k_tile];
+		out_s0 = 1;         out_s1 = out_stride[k_tile];
+		in_s0 = in_stride[order[0]]; in_s1 = in_stride[order[k_tile]];
+		n_tile0 = (n0+tile-1)/tile;
+		n_tile1 = (n1+tile-1)/tile;
+
+		for (std::size_t k=1, j=0; k<dim; k++) {
+			if (k==k_tile) continue;
+			rest_n[j] = out_n[k];
+			rest_out_s[j] = out_stride[k];
+			rest_in_s[j]  = in_stride[order[k]];
+			j++;
+		}
+	}
+
+	// bytes read and written by one call
+	std::size_t bytes() const { return 2*n_tot*sizeof(val_type); }
+
+#ifdef __CUDACC__
+	// tile t by a block of tile x rows threads: read into buf a row of
+	// the input's contiguous axis at a time, written out a row of the 
+	// output's; the padding column keeps the columns in different banks
+	__device__ void copy_tile(const val_type* in, val_type* out, 
+														std::size_t t) const {
+		__shared__ val_type buf[tile][tile+1];
+
+		std::size_t j0 = t%n_tile0*tile, j1 = t/n_tile0%n_tile1*tile;
+		std::size_t rest = t/(n_tile0*n_tile1), in_r = 0, out_r = 0;
+		for (std::size_t j=0; j<dim-2; j++) {
+			std::size_t r = rest%rest_n[j];
+			rest /= rest_n[j];
+			out_r += r*rest_out_s[j];
+			in_r  += r*rest_in_s[j];
+		}
+
+		__syncthreads(); // the block is done with the previous tile
+		for (std::size_t y=threadIdx.y; y<tile; y+=blockDim.y) {
+			std::size_t i0 = j0+y, i1 = j1+threadIdx.x;
+			if (i0<n0 && i1<n1) buf[y][threadIdx.x] = in[in_r+i0*in_s0+i1];
+		}
+		__syncthreads();
+		for (std::size_t y=threadIdx.y; y<tile; y+=blockDim.y) {
+			std::size_t i0 = j0+threadIdx.x, i1 = j1+y;
+			if (i0<n0 && i1<n1) out[out_r+i0+i1*out_s1] = buf[threadIdx.x][y];
+		}
+	}
+#endif
+
+	template <typename InputIterator, typename OutputIterator>
+	void operator()(InputIterator in_itor_begin, OutputIterator out_itor_begin) {
+
+		std::size_t n_rest = n_tot/(n0*n1);
+
+#ifdef __CUDACC__
+		// the input's contiguous axis is the second tiled one unless the
+		// fastest axis stays in place, where the loop below coalesces
+		if constexpr (std::is_arithmetic_v<val_type> &&
+									thrust::is_contiguous_iterator_v<InputIterator> &&
+									thrust::is_contiguous_iterator_v<OutputIterator>) 
+		if (in_s1==1) {
+			std::size_t n_tile = n_rest*n_tile0*n_tile1;
+			tiled_reorder_kernel<<<std::min<std::size_t>(n_tile,1<<20),
+														 dim3(tile,8)>>>(*this,
+				thrust::raw_pointer_cast(&in_itor_begin[0]),
+				thrust::raw_pointer_cast(&out_itor_begin[0]),n_tile);
+			return;
+		}
+#endif
+		std::size_t n_work = n_rest*n_tile1*n_tile0*tile*tile;
+
+		thrust::for_each(thrust::make_counting_iterator<std::size_t>(0),
+										thrust::make_counting_iterator(n_work),
+		[=,*this](std::size_t w) {
+			std::size_t i0 = w%tile + (w/(tile*tile))%n_tile0*tile;
+			std::size_t i1 = (w/tile)%tile + (w/(tile*tile*n_tile0))%n_tile1*tile;
+			if (i0>=n0 || i1>=n1) return; // padding of the edge tiles
+
+			std::size_t rest = w/(tile*tile*n_tile0*n_tile1);
+			std::size_t out = i0*out_s0 + i1*out_s1, in = i0*in_s0 + i1*in_s1;
+			for (std::size_t j=0; j<dim-2; j++) {
+				std::size_t r = rest%rest_n[j];
+				rest /= rest_n[j];
+				out += r*rest_out_s[j];
+				in  += r*rest_in_s[j];
+			}
+			out_itor_begin[out] = in_itor_begin[in];
+		});
+
+	}
+
+};
+
+} // namespace quakins
+
+#endif /* _TILED_REORDER_COPY_HPP_ */
@@ -6,20 +6,21 @@
 
 class Timer {
 		
+		// steady_clock, wall time that never jumps
 		std::chrono::time_point<
-						std::chrono::high_resolution_clock
+						std::chrono::steady_clock
 						> time1, time2, time3;
 public:
 		Timer() {}
 	
 		void tick(std::string message) {
-				time1 = std::chrono::system_clock::now();
+				time1 = std::chrono::steady_clock::now();
 
 				std::cout << message << std::flush;		
 		}
 		void tock() {
 					
-				time2 = std::chrono::system_clock::now();
+				time2 = std::chrono::steady_clock::now();
 				auto int_ms = std::chrono::duration_cast<
 								std::chrono::milliseconds>(time2 - time1);
 				
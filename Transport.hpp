@@ -0,0 +1,295 @@
+#ifndef _TRANSPORT_HPP_
+#define _TRANSPORT_HPP_
+
+#include "Backend.hpp"
+#include <algorithm>
+#include <atomic>
+#include <barrier>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace quakins {
+
+/**
+ *  What the ranks of a decomposed run exchange, behind one interface so
+ *  the same driver runs on threads of one process, on processes of one
+ *  node, or on whatever else implements it (MPI, NCCL). Data is in host
+ *  memory; allreduce() in Decomposition.hpp stages device vectors.
+ */
+class Transport {
+public:
+	virtual ~Transport() {}
+
+	virtual int rank() const = 0;
+	virtual int size() const = 0;
+	virtual void barrier() = 0;
+
+	// data becomes the sum of data over all ranks, on every rank
+	virtual void allreduce(float* data, std::size_t n) = 0;
+	virtual void allreduce(double* data, std::size_t n) = 0;
+
+	// n values to the ranks left and right and n values from each; 
+	// from_left is what left sent as to_right
+	virtual void exchange(int left, int right,
+												const float* to_left, const float* to_right,
+												float* from_left, float* from_right, std::size_t n) = 0;
+	virtual void exchange(int left, int right,
+												const double* to_left, const double* to_right,
+												double* from_left, double* from_right, std::size_t n) = 0;
+};
+
+/**
+ *  Ranks of one node exchanging through a buffer they all map: every
+ *  rank puts its part into its own slot of capacity bytes and, after a
+ *  barrier, adds up all slots in rank order, so every rank ends up with
+ *  the same bits. Longer data goes through in chunks.
+ */
+class SharedBufferTransport : public Transport {
+
+protected:
+	int _rank, _size;
+	char* slots;
+	std::size_t capacity; // bytes per rank
+
+	SharedBufferTransport(int rank, int size, char* slots, std::size_t capacity)
+	: _rank(rank), _size(size), slots(slots), capacity(capacity) {}
+
+	template <typename val_type>
+	val_type* slot(int r) { return reinterpret_cast<val_type*>(slots+r*capacity); }
+
+	template <typename val_type>
+	void sum(val_type* data, std::size_t n) {
+		std::size_t chunk = capacity/sizeof(val_type);
+		for (std::size_t i0=0; i0<n; i0+=chunk) {
+			std::size_t m = std::min(chunk,n-i0);
+			std::memcpy(slot<val_type>(_rank),data+i0,m*sizeof(val_type));
+			barrier();
+			std::copy(slot<val_type>(0),slot<val_type>(0)+m,data+i0);
+			for (int r=1; r<_size; r++) {
+				auto s = slot<val_type>(r);
+				for (std::size_t i=0; i<m; i++) data[i0+i] += s[i];
+			}
+			barrier(); // the slots are free again
+		}
+	}
+
+	// the first half of a slot goes left, the second right
+	template <typename val_type>
+	void swap_halves(int left, int right,
+									 const val_type* to_left, const val_type* to_right,
+									 val_type* from_left, val_type* from_right, std::size_t n) {
+		std::size_t chunk = capacity/2/sizeof(val_type);
+		for (std::size_t i0=0; i0<n; i0+=chunk) {
+			std::size_t m = std::min(chunk,n-i0);
+			std::copy(to_left+i0,to_left+i0+m,slot<val_type>(_rank));
+			std::copy(to_right+i0,to_right+i0+m,slot<val_type>(_rank)+chunk);
+			barrier();
+			std::copy(slot<val_type>(left)+chunk,slot<val_type>(left)+chunk+m,
+								from_left+i0);
+			std::copy(slot<val_type>(right),slot<val_type>(right)+m,from_right+i0);
+			barrier();
+		}
+	}
+
+public:
+	int rank() const override { return _rank; }
+	int size() const override { return _size; }
+
+	void allreduce(float* data, std::size_t n) override { sum(data,n); }
+	void allreduce(double* data, std::size_t n) override { sum(data,n); }
+
+	void exchange(int left, int right,
+								const float* to_left, const float* to_right,
+								float* from_left, float* from_right, std::size_t n) override {
+		swap_halves(left,right,to_left,to_right,from_left,from_right,n);
+	}
+	void exchange(int left, int right,
+								const double* to_left, const double* to_right,
+								double* from_left, double* from_right, std::size_t n) override {
+		swap_halves(left,right,to_left,to_right,from_left,from_right,n);
+	}
+};
+
+/// ranks as threads of one process
+class ThreadTransport : public SharedBufferTransport {
+public:
+	struct World {
+		int size;
+		std::size_t capacity;
+		std::barrier<> bar;
+		std::vector<char> buffer;
+		World(int size, std::size_t capacity = 1<<22)
+		: size(size), capacity(capacity), bar(size), buffer(size*capacity) {}
+	};
+
+	ThreadTransport(World& world, int rank)
+	: SharedBufferTransport(rank,world.size,world.buffer.data(),world.capacity),
+		world(world) {}
+
+	void barrier() override { world.bar.arrive_and_wait(); }
+
+private:
+	World& world;
+};
+
+/**
+ *  Ranks as processes of one node, forked from the first: the barrier
+ *  and the slots live in a shared anonymous mapping made before the
+ *  fork. On the device backend fork before anything touches CUDA.
+ */
+class ShmTransport : public SharedBufferTransport {
+public:
+	class World {
+		pthread_barrier_t* bar = nullptr;
+		std::atomic<int>* n_failed = nullptr; // in the padding after bar
+		std::size_t bytes;
+		bool owner = true; // the process that made it
+		std::vector<pid_t> children;
+	public:
+		int size;
+		std::size_t capacity;
+		char* slots = nullptr;
+
+		World(int size, std::size_t capacity = 1<<22)
+		: bytes(sizeof(pthread_barrier_t)+64+size*capacity),
+			size(size), capacity(capacity) {
+			void* ptr = mmap(nullptr,bytes,PROT_READ|PROT_WRITE,
+											 MAP_SHARED|MAP_ANONYMOUS,-1,0);
+			if (ptr==MAP_FAILED) {
+				std::cerr << "cannot map " << bytes << " bytes shared" << std::endl;
+				return;
+			}
+			bar = static_cast<pthread_barrier_t*>(ptr);
+			n_failed = new (static_cast<char*>(ptr)+sizeof(pthread_barrier_t))
+										std::atomic<int>(0);
+			slots = static_cast<char*>(ptr)+sizeof(pthread_barrier_t)+64;
+			pthread_barrierattr_t attr;
+			pthread_barrierattr_init(&attr);
+			pthread_barrierattr_setpshared(&attr,PTHREAD_PROCESS_SHARED);
+			pthread_barrier_init(bar,&attr,size);
+			pthread_barrierattr_destroy(&attr);
+		}
+		World(const World&) = delete;
+		World& operator=(const World&) = delete;
+
+		~World() {
+			if (!bar) return;
+			if (owner) pthread_barrier_destroy(bar);
+			munmap(bar,bytes);
+		}
+
+		bool ok() const { return bar!=nullptr; }
+
+		// forks size-1 processes, returns the rank of the calling one,
+		// 0 for the process that forked, -1 if that failed; the ranks
+		// forked by then would wait at the barrier for good, so they are
+		// killed
+		int fork() {
+			for (int r=1; r<size; r++) {
+				pid_t pid = ::fork();
+				if (pid<0) { 
+					std::cerr << "cannot fork rank " << r << std::endl;
+					for (auto child : children) kill(child,SIGKILL);
+					for (auto child : children) waitpid(child,nullptr,0);
+					children.clear();
+					owner = false; // destroying bar would wait for the killed
+					return -1;
+				}
+				if (pid==0) { children.clear(); owner = false; return r; }
+				children.push_back(pid);
+			}
+			return 0;
+		}
+
+		// true on every rank if ok is on all of them, all ranks call it
+		bool all(bool ok) {
+			if (!ok) n_failed->fetch_add(1);
+			pthread_barrier_wait(bar);
+			return n_failed->load()==0;
+		}
+
+		// rank 0 waits for the others, true if all of them succeeded
+		bool join() {
+			bool ok = true;
+			for (auto pid : children) {
+				int status = 0;
+				waitpid(pid,&status,0);
+				ok = ok && WIFEXITED(status) && WEXITSTATUS(status)==0;
+			}
+			return ok;
+		}
+
+		friend class ShmTransport;
+	};
+
+	ShmTransport(World& world, int rank)
+	: SharedBufferTransport(rank,world.size,world.slots,world.capacity),
+		bar(world.bar) {}
+
+	void barrier() override { pthread_barrier_wait(bar); }
+
+private:
+	pthread_barrier_t* bar;
+};
+
+/**
+ *  run(transport) on every rank of n_rank, kind "thread" for threads of
+ *  this process, which on the device backend share one GPU (QUAKINS_DEVICE),
+ *  or "shm" for processes forked from it, each on its own GPU. The exit
+ *  code of main for the calling process: 0 if all the ranks it waits for
+ *  returned.
+ */
+template <typename Func>
+int run_ranks(int n_rank, std::string kind, Func run) {
+
+	if (kind=="thread") {
+		// the GPU the threads share, checked once
+		if (backend::on_device && !backend::select_device()) return 1;
+		ThreadTransport::World world(n_rank);
+		std::vector<std::thread> ranks;
+		for (int r=0; r<n_rank; r++)
+			ranks.emplace_back([&world,&run,r,n_rank] {
+				// the current GPU is per thread, the host cores are shared out
+				if (backend::on_device) backend::select_device();
+				else backend::select_rank_device(r,n_rank);
+				ThreadTransport transport(world,r);
+				run(transport);
+			});
+		for (auto& t : ranks) t.join();
+		return 0;
+	}
+	if (kind!="shm") {
+		std::cerr << "no transport named " << kind << std::endl;
+		return 1;
+	}
+
+	ShmTransport::World world(n_rank);
+	if (!world.ok()) return 1;
+	int rank = world.fork();
+	if (rank<0) return 1;
+	// no rank runs unless all have a GPU, else the others would wait
+	if (!world.all(backend::select_rank_device(rank,n_rank))) {
+		if (rank>0) return 1;
+		world.join();
+		return 1;
+	}
+	{
+		ShmTransport transport(world,rank);
+		run(transport);
+	}
+	if (rank>0) return 0;
+	return world.join()? 0 : 1;
+}
+
+} // namespace quakins
+
+#endif /* _TRANSPORT_HPP_ */
@@ -0,0 +1,113 @@
+#ifndef _WIGNER_SOLVER_HPP_
+#define _WIGNER_SOLVER_HPP_
+
+#include "CoordinateSystem.hpp"
+#include "FreeStreamSolver.hpp"
+#include "FFTPlanCache.hpp"
+#include "BufferPool.hpp"
+#include <thrust/for_each.h>
+#include <thrust/iterator/counting_iterator.h>
+#include <map>
+#include <memory>
+#include <utility>
+#include <cmath>
+
+namespace quakins {
+namespace fbm {
+
+/**
+ *  The nonlocal Wigner term of a 1D1V run, df/dt = theta[U]f, solved
+ *  exactly in the Fourier space of v: with f(x,lambda) the transform of
+ *  f(x,v) over v,
+ *
+ *    f(x,lambda,t+dt) = f(x,lambda,t)
+ *                     * exp(i dt (U(x+hbar lambda/2)-U(x-hbar lambda/2))/hbar),
+ *
+ *  where the potential energy U is interpolated linearly and is periodic.
+ *  One batched R2C transform along v for all the spatial cells, the 
+ *  phase multiplication and one batched C2R; the plans come from the
+ *  FFTPlanCache on first use of a layout of f, the complex buffer from a
+ *  pool. As hbar goes to 0 this is the acceleration -dU/dx of 
+ *  AccelerationSolver.
+ */
+template <typename val_type, std::size_t dim>
+class WignerSolver {
+
+	static_assert(dim==2, "the Wigner term is implemented for 1D1V");
+
+	using complex_type = typename FFT<val_type,1>::complex_type;
+
+	std::size_t nx, nBd, nv, nvBd;
+	val_type dt, hbar, dx, dv;
+	AxisStride natural;
+	std::map<std::pair<std::size_t,std::size_t>,
+					 std::shared_ptr<FFT<val_type,1>>> plans;
+	BufferPool<complex_type,thrust::device_vector> pool;
+
+	// x stride: between spatial cells, v stride: along the velocity
+	FFT<val_type,1>& plan(AxisStride stride) {
+		auto& p = plans[{stride.x,stride.v}];
+		if (!p) p = fft_plan<val_type,1>({nv},{nv},nx,
+			FFTLayout{stride.v,stride.x}, FFTLayout{nx,1});
+		return *p;
+	}
+
+public:
+	WignerSolver(const CoordinateSystem<val_type,dim>& coord,
+							 val_type dt, val_type hbar) : dt(dt), hbar(hbar) {
+		nx = coord.nz[0]; nBd = coord.nBd[0]; dx = coord.dz[0];
+		nv = coord.nz[1]; nvBd = coord.nBd[1]; dv = coord.dz[1];
+		natural = {1, coord.nzTot[0]};
+	}
+
+	std::size_t n_plan() const { return plans.size(); }
+
+	// f in the layout of the CoordinateSystem
+	template <typename itor_type, typename U_container>
+	void operator()(itor_type itor_begin, const U_container& U) {
+		(*this)(itor_begin,U,natural);
+	}
+
+	// U holds the potential energy of every spatial cell, ghosts included
+	template <typename itor_type, typename U_container>
+	void operator()(itor_type itor_begin, const U_container& U,
+									AxisStride stride) {
+
+		auto& fft = plan(stride);
+		std::size_t n_k = fft.complex_size();
+		auto buffer = pool.acquire(n_k*nx);
+
+		auto f_ptr = thrust::raw_pointer_cast(&itor_begin[0])
+								+ nBd*stride.x + nvBd*stride.v;
+		auto buf_ptr = buffer.data();
+		auto U_ptr = thrust::raw_pointer_cast(U.data()) + nBd;
+
+		fft.forward(f_ptr,buf_ptr);
+
+		// lambda = 2 pi k/(nv dv), the shift hbar lambda/2 in cells of x
+		std::size_t nx = this->nx;
+		val_type shift = hbar*M_PI/(nv*dv)/dx, phase = dt/hbar, norm = val_type(1)/nv;
+		thrust::for_each(thrust::make_counting_iterator<std::size_t>(0),
+										thrust::make_counting_iterator(n_k*nx),
+		[=](std::size_t t) {
+			std::size_t k = t/nx, i = t%nx;
+			auto U_at = [&](val_type pos) {
+				val_type fl = std::floor(pos), w = pos-fl;
+				std::ptrdiff_t n = nx, j = static_cast<std::ptrdiff_t>(fl)%n;
+				if (j<0) j += n;
+				return (1-w)*U_ptr[j] + w*U_ptr[(j+1)%n];
+			};
+			val_type d = shift*k;
+			val_type theta = phase*(U_at(i+d)-U_at(i-d));
+			buf_ptr[t] *= complex_type(std::cos(theta),std::sin(theta))*norm;
+		});
+
+		fft.backward(buf_ptr,f_ptr);
+	}
+
+};
+
+} // namespace fbm
+} // namespace quakins
+
+#endif /* _WIGNER_SOLVER_HPP_ */
@@ -0,0 +1,105 @@
+#include <iostream>
+#include "Bench.hpp"
+#include "DensityReducer.hpp"
+#include "MomentReducer.hpp"
+#include "TiledReorderCopy.hpp"
+#include <thrust/device_vector.h>
+#include <thrust/transform.h>
+#include <thrust/transform_reduce.h>
+#include <thrust/iterator/zip_iterator.h>
+#include <thrust/functional.h>
+#include <cmath>
+
+using Real = float;
+using quakins::bench::time_ms;
+
+template <typename Vector>
+Real max_diff(const Vector& a, const Vector& b) {
+	return thrust::transform_reduce(
+		thrust::make_zip_iterator(thrust::make_tuple(a.begin(),b.begin())),
+		thrust::make_zip_iterator(thrust::make_tuple(a.end(),b.end())),
+		[](auto t) { return std::abs(thrust::get<0>(t)-thrust::get<1>(t)); },
+		Real(0), thrust::maximum<Real>());
+}
+
+// the chained DensityReducer on {v1,v2,x} data (plus the transpose it
+// needs on the natural {x,v1,v2} layout) against the fused reducer
+template <std::size_t nx, std::size_t nv1, std::size_t nv2>
+void compare(std::string name, int n_rep) {
+
+	constexpr std::size_t n_tot = nx*nv1*nv2;
+	const Real v1Min = -6, v1Max = 6, v2Min = -5, v2Max = 5;
+
+	thrust::device_vector<Real> f_nat(n_tot), f_vin(n_tot);
+	thrust::transform(thrust::make_counting_iterator<std::size_t>(0),
+									  thrust::make_counting_iterator(n_tot),f_nat.begin(),
+		[](std::size_t i) { return std::sin(.001f*i)+1.5f; });
+
+	quakins::TiledReorderCopy<Real,3> copyV({1,2,0},{nx,nv1,nv2});
+	copyV(f_nat.begin(),f_vin.begin());
+
+	quakins::DensityReducer<Real,nv1,nx*nv2,
+		thrust::device_vector> cal_dens_1(v1Min,v1Max);
+	quakins::DensityReducer<Real,nv2,nx,
+		thrust::device_vector> cal_dens_2(v2Min,v2Max);
+	quakins::FusedDensityReducer<Real,nx,true,nv1,nv2>
+		fused_vin({v1Min,v1Max,v2Min,v2Max});
+	quakins::FusedDensityReducer<Real,nx,false,nv1,nv2>
+		fused_nat({v1Min,v1Max,v2Min,v2Max});
+
+	thrust::device_vector<Real> buf(nx*nv2), d0(nx), d1(nx), d2(nx);
+
+	double t_2p = time_ms([&]{
+		cal_dens_1(f_vin.begin(),buf.begin());
+		cal_dens_2(buf.begin(),d0.begin()); },n_rep);
+	double t_tr = time_ms([&]{ copyV(f_nat.begin(),f_vin.begin()); },n_rep);
+	double t_fv = time_ms([&]{ fused_vin(f_vin.begin(),d1.begin()); },n_rep);
+	double t_fn = time_ms([&]{ fused_nat(f_nat.begin(),d2.begin()); },n_rep);
+
+	auto GBps = [&](double ms) { return fused_nat.bytes()/ms/1.e6; };
+
+	std::cout << name << ": two-pass " << t_2p << "ms (+" << t_tr
+						<< "ms transpose), fused v-inner " << t_fv << "ms ("
+						<< GBps(t_fv) << "GB/s), fused natural " << t_fn << "ms ("
+						<< GBps(t_fn) << "GB/s), max diff " << max_diff(d0,d1)
+						<< " / " << max_diff(d0,d2) << std::endl;
+}
+
+// the moment engine against the fused density: asking for more moments
+// should cost about the same single read of f
+void compare_moments(int n_rep) {
+
+	constexpr std::size_t nx1 = 100, nx2 = 80, nv1 = 66, nv2 = 60;
+	quakins::CoordinateSystem<Real,4> coord({nx1,nx2,nv1,nv2},{4,4,0,0},
+																					{0,20,0,20,-6,6,-6,6});
+	constexpr std::size_t nx = (nx1+8)*(nx2+8);
+	thrust::device_vector<Real> f(nx*nv1*nv2), d(nx);
+	thrust::transform(thrust::make_counting_iterator<std::size_t>(0),
+									  thrust::make_counting_iterator(f.size()),f.begin(),
+		[](std::size_t i) { return std::sin(.001f*i)+1.5f; });
+
+	quakins::FusedDensityReducer<Real,nx,false,nv1,nv2> fused({-6,6,-6,6});
+	double t_d = time_ms([&]{ fused(f.begin(),d.begin()); },n_rep);
+	std::cout << "2d2v density " << t_d << "ms" << std::endl;
+
+	using namespace quakins::moment;
+	for (unsigned mask : std::array<unsigned,4>{density, density|current, 
+												density|current|energy, all}) {
+		quakins::MomentReducer<Real,4,false> moments(coord,mask);
+		double t_m = time_ms([&]{ moments(f.begin()); },n_rep);
+		std::cout << "2d2v moments " << mask << ": " << t_m << "ms (" 
+							<< moments.bytes()/t_m/1.e6 << "GB/s, " << t_m/t_d 
+							<< "x density), max diff " << max_diff(moments.density(),d)
+							<< std::endl;
+	}
+}
+
+int main(int argc, char* argv[]) {
+
+	int n_rep = argc>1? std::stoi(argv[1]) : 20;
+
+	compare<108*88,66,60>("2d2v main_2d",n_rep);
+	compare<512,64,64>("x 512, v 64x64",n_rep);
+	compare_moments(n_rep);
+
+}
@@ -0,0 +1,256 @@
+#include <iostream>
+#include <cmath>
+#include "Bench.hpp"
+#include "FreeStreamSolver.hpp"
+#include "AccelerationSolver.hpp"
+#include "PhaseSpaceInitialization.hpp"
+#include "MemSaveReorderCopy.hpp"
+#include "TiledReorderCopy.hpp"
+#include "DensityReducer.hpp"
+#include <thrust/transform_reduce.h>
+#include <thrust/functional.h>
+#include <thrust/sequence.h>
+
+using Real = float;
+using quakins::bench::time_ms;
+
+// The original per-velocity-row advection, kept as the reference
+// the free streaming solver is measured and checked against.
+template <typename val_type, std::size_t dim, std::size_t ndim>
+struct PerRowFreeStream {
+
+	std::size_t nx, nBd, nTot;
+	thrust::device_vector<val_type> Phi;
+	thrust::host_vector<val_type> alpha;
+
+	PerRowFreeStream(const quakins::CoordinateSystem<val_type,dim>& coord,
+									 val_type dt) {
+		std::size_t vdim = ndim + (dim>>1);
+		nBd  = coord.nBd[ndim];
+		nx   = coord.nz[ndim];
+		nTot = thrust::reduce(coord.nzTot.begin(), coord.nzTot.end(),1,
+													thrust::multiplies<std::size_t>());
+		Phi.resize(nTot);
+		alpha.resize(coord.nz[vdim]);
+		thrust::transform(coord.coord[vdim].begin(),coord.coord[vdim].end(),
+			alpha.begin(),[&](auto &v){ return v*dt/coord.dz[ndim]; });
+	}
+
+	template <typename itor_type>
+	void operator()(itor_type itor_begin, std::size_t n_chunk) {
+
+		std::size_t n_step = nTot/n_chunk;
+		using quakins::fbm::strided_chunk_range;
+
+		strided_chunk_range<itor_type>
+			left_inside(itor_begin+nBd,itor_begin+nTot,nx+2*nBd, nBd);
+		strided_chunk_range<itor_type>
+			left_outside(itor_begin,itor_begin+nTot,nx+2*nBd, nBd);
+		strided_chunk_range<itor_type>
+			right_inside(itor_begin+nx,itor_begin+nTot,nx+2*nBd, nBd);
+		strided_chunk_range<itor_type>
+			right_outside(itor_begin+nx+nBd,itor_begin+nTot,nx+2*nBd, nBd);
+
+		thrust::copy(left_inside.begin(),left_inside.end(),
+										right_outside.begin());
+		thrust::copy(right_inside.begin(),right_inside.end(),
+										left_outside.begin());
+
+		auto zitor_pos_begin = thrust::make_zip_iterator(thrust::make_tuple(
+				Phi.begin()+nTot/2, itor_begin-1+nTot/2,
+				itor_begin+nTot/2, itor_begin+1+nTot/2));
+		auto zitor_neg_begin = thrust::make_zip_iterator(thrust::make_tuple(
+				Phi.begin(), itor_begin, itor_begin+1, itor_begin+2));
+
+		for (std::size_t i = 0; i<n_step/2; i++) {
+			thrust::for_each(zitor_neg_begin+nBd-1,
+											zitor_neg_begin+n_chunk-nBd+1,
+			[a=alpha[i]](auto tuple){
+				thrust::get<0>(tuple) = a*(thrust::get<2>(tuple)
+				-(1-a)*(1+a)/6*(thrust::get<3>(tuple)-thrust::get<2>(tuple))
+				-(2+a)*(1+a)/6*(thrust::get<2>(tuple)-thrust::get<1>(tuple)));
+			});
+			zitor_neg_begin += n_chunk;
+		}
+		for (std::size_t i = n_step/2; i<n_step; i++) {
+			thrust::for_each(zitor_pos_begin+nBd-1,
+											zitor_pos_begin+n_chunk-nBd+1,
+			[a=alpha[i]](auto tuple){
+				thrust::get<0>(tuple) = a*(thrust::get<2>(tuple)
+				+(1-a)*(2-a)/6*(thrust::get<3>(tuple)-thrust::get<2>(tuple))
+				+(1-a)*(1+a)/6*(thrust::get<2>(tuple)-thrust::get<1>(tuple)));
+			});
+			zitor_pos_begin += n_chunk;
+		}
+
+		auto zitor_begin = thrust::make_zip_iterator(thrust::make_tuple(
+														itor_begin,Phi.begin()-1,Phi.begin()));
+		thrust::for_each(zitor_begin+nBd,zitor_begin+nTot-nBd,
+		[](auto tuple) {
+			thrust::get<0>(tuple) += thrust::get<1>(tuple)-thrust::get<2>(tuple);
+		});
+	}
+};
+
+
+// max |a-b| over the cells inside the lines of n_line
+template <typename Container>
+Real max_diff(const Container& a, const Container& b, 
+							std::size_t n_line, std::size_t nBd) {
+	auto zitor = thrust::make_zip_iterator(thrust::make_tuple(
+						thrust::make_counting_iterator<std::size_t>(0),
+						a.begin(),b.begin()));
+	return thrust::transform_reduce(zitor, zitor+a.size(),
+		[n_line,nBd](auto tuple) {
+			std::size_t i = thrust::get<0>(tuple) % n_line;
+			if (i<nBd || i>=n_line-nBd) return Real(0);
+			Real d = thrust::get<1>(tuple)-thrust::get<2>(tuple);
+			return d<0? -d:d; }, Real(0), thrust::maximum<Real>());
+}
+
+template <std::size_t dim, std::size_t ndim>
+void compare(std::string name,
+						 quakins::CoordinateSystem<Real,dim>& coord,
+						 Real dt, std::size_t n_chunk, int n_rep) {
+
+	quakins::fbm::FreeStreamSolver<Real,dim,ndim> solver(coord,dt);
+	PerRowFreeStream<Real,dim,ndim> per_row(coord,dt);
+
+	std::size_t nTot = solver.nTot;
+	auto f = [](std::array<Real,dim> z) {
+		Real val = 1.;
+		for (std::size_t i=0; i<dim/2; i++)
+			val *= 1.+.1*std::cos(z[i]) ;
+		for (std::size_t i=dim/2; i<dim; i++)
+			val *= std::exp(-z[i]*z[i]/2.);
+		return val;
+	};
+	thrust::device_vector<Real> f1(nTot), f2(nTot), f3(nTot), buf(nTot);
+	quakins::PhaseSpaceInitialization<Real,dim> init(&coord);
+	init(f1.begin(),f);
+	f2 = f1; f3 = f1;
+
+	double t_row = time_ms([&]{ per_row(f1.begin(),n_chunk); }, n_rep);
+	double t_ip  = time_ms([&]{ solver(f2.begin(),n_chunk); }, n_rep);
+	double t_pp  = time_ms([&]{ solver(f3.begin(),buf.begin(),n_chunk); 
+															f3.swap(buf); }, n_rep);
+
+	std::size_t n_line = solver.nx+2*solver.nBd;
+	std::cout << name << ": per-row " << t_row << "ms, in-place " 
+						<< t_ip << "ms (x" << t_row/t_ip << "), ping-pong "
+						<< t_pp << "ms (x" << t_row/t_pp << "), max|diff| "
+						<< max_diff(f1,f2,n_line,solver.nBd) << " / "
+						<< max_diff(f1,f3,n_line,solver.nBd) << std::endl;
+}
+
+
+// x2 of the 2D2V run: streamed along its stride in the {x1,x2,v1,v2}
+// layout against transposing it to the front and back again
+template <std::size_t nx1Tot, std::size_t nx2Tot, 
+					std::size_t nv1, std::size_t nv2>
+void compare_strided(quakins::CoordinateSystem<Real,4>& coord,
+										 Real dt, int n_rep) {
+
+	constexpr std::size_t nTot = nx1Tot*nx2Tot*nv1*nv2;
+	quakins::fbm::FreeStreamSolver<Real,4,1> solver(coord,dt);
+	quakins::MemSaveReorderCopy<Real,4,nTot> 
+		forth({1,0,2,3},{nx1Tot,nx2Tot,nv1,nv2}),
+		back({1,0,2,3},{nx2Tot,nx1Tot,nv1,nv2});
+
+	thrust::device_vector<Real> f1(nTot), f2(nTot), buf(nTot);
+	thrust::sequence(f1.begin(),f1.end());
+	f2 = f1;
+
+	double t_tr = time_ms([&]{ forth(f1.begin(),buf.begin());
+														 solver(buf.begin(),nx1Tot*nx2Tot*nv1);
+														 back(buf.begin(),f1.begin()); }, n_rep);
+	double t_st = time_ms([&]{ solver(f2.begin()); }, n_rep);
+
+	std::cout << "2d2v x2 strided: transposed " << t_tr << "ms, strided "
+						<< t_st << "ms (x" << t_tr/t_st << ")" << std::endl;
+}
+
+
+// the inner iteration of main_1d: advect, transpose, reduce and transpose
+// back against the ping-pong advection writing the density on the way
+void compare_density(quakins::CoordinateSystem<Real,2>& coord,
+										 Real dt, int n_rep) {
+
+	constexpr std::size_t nx1Tot = 512, nv1 = 256, nTot = nx1Tot*nv1;
+	quakins::fbm::FreeStreamSolver<Real,2,0> solver(coord,dt);
+	quakins::TiledReorderCopy<Real,2> copy1({1,0},{nx1Tot,nv1});
+	quakins::TiledReorderCopy<Real,2> copy2({1,0},{nv1,nx1Tot});
+	quakins::DensityReducer<Real,nv1,nx1Tot,
+		thrust::device_vector> cal_dens(-6,6);
+
+	thrust::device_vector<Real> f1(nTot), f2(nTot), buf(nTot);
+	thrust::device_vector<Real> dens1(nx1Tot), dens2(nx1Tot);
+	thrust::transform(thrust::make_counting_iterator<std::size_t>(0),
+									  thrust::make_counting_iterator(nTot),f1.begin(),
+		[](std::size_t i) { return std::sin(.01f*i)+1.5f; });
+	f2 = f1;
+
+	// both run warm-up plus n_rep steps, so they end at the same time
+	double t_old = time_ms([&]{ solver(f1.begin(),nx1Tot);
+															copy1(f1.begin(),buf.begin());
+															cal_dens(buf.begin(),dens1.begin());
+															copy2(buf.begin(),f1.begin()); }, n_rep);
+	double t_new = time_ms([&]{ solver.advect_with_density(f2.begin(),
+																buf.begin(),dens2.begin());
+															f2.swap(buf); }, n_rep);
+
+	std::cout << "1d1v advect+density: separate passes " << t_old 
+						<< "ms, fused " << t_new << "ms (x" << t_old/t_new 
+						<< "), max|diff| f " << max_diff(f1,f2,nx1Tot,6)
+						<< ", density " << max_diff(dens1,dens2,nx1Tot,6) << std::endl;
+}
+
+
+// the velocity advection sweeps the strided v axis of the natural layout
+// in place; it should cost about what the x sweep costs on the same f
+template <std::size_t dim, std::size_t vdim>
+void compare_acceleration(std::string name,
+													quakins::CoordinateSystem<Real,dim>& coord,
+													Real dt, int n_rep) {
+
+	quakins::fbm::FreeStreamSolver<Real,dim,0> x_solver(coord,dt);
+	quakins::fbm::AccelerationSolver<Real,dim,vdim> v_solver(coord,dt);
+
+	thrust::device_vector<Real> f(x_solver.nTot), a(v_solver.n_space);
+	thrust::transform(thrust::make_counting_iterator<std::size_t>(0),
+									  thrust::make_counting_iterator(f.size()),f.begin(),
+		[](std::size_t i) { return std::sin(.01f*i)+1.5f; });
+	thrust::transform(thrust::make_counting_iterator<std::size_t>(0),
+									  thrust::make_counting_iterator(a.size()),a.begin(),
+		[](std::size_t i) { return .1f*std::cos(.1f*i); });
+
+	double t_x = time_ms([&]{ x_solver(f.begin()); }, n_rep);
+	double t_v = time_ms([&]{ v_solver(f.begin(),a.begin()); }, n_rep);
+
+	std::cout << name << ": x sweep " << t_x << "ms, v sweep " << t_v 
+						<< "ms" << std::endl;
+}
+
+
+int main(int argc, char* argv[]) {
+
+	int n_rep = argc>1? std::stoi(argv[1]) : 20;
+
+	// the 1D1V setup of main_1d.cu
+	quakins::CoordinateSystem<Real,2>
+		coord_1d({500,256},{6,0},{0,20,-6,6});
+	compare<2,0>("1d1v x1",coord_1d,20./500/6/2.3*.5,512,n_rep);
+	compare_density(coord_1d,20./500/6/2.3*.5,n_rep);
+	compare_acceleration<2,1>("1d1v v1",coord_1d,20./500/6/2.3,n_rep);
+
+	// the 2D2V setup of main_2d.cu, the chunks are those passed
+	// to fbmSolverX1 and fbmSolverX2 there
+	quakins::CoordinateSystem<Real,4>
+		coord_2d({100,80,66,60},{4,4,0,0},{0,20,0,20,-6,6,-6,6});
+	compare<4,0>("2d2v x1",coord_2d,.005,108*88*60,n_rep);
+	compare<4,1>("2d2v x2",coord_2d,.005,108*88*66,n_rep);
+	compare_strided<108,88,66,60>(coord_2d,.005,n_rep);
+	compare_acceleration<4,2>("2d2v v1",coord_2d,.01,n_rep);
+	compare_acceleration<4,3>("2d2v v2",coord_2d,.01,n_rep);
+
+}
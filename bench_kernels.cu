@@ -0,0 +1,236 @@
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include "Backend.hpp"
+#include "Bench.hpp"
+#include "FreeStreamSolver.hpp"
+#include "ReorderCopy.hpp"
+#include "MemSaveReorderCopy.hpp"
+#include "DensityReducer.hpp"
+#include "PoissonSolver1D.hpp"
+#include "reorder_copy.h"
+#include <thrust/device_vector.h>
+#include <thrust/sequence.h>
+#include <thrust/copy.h>
+#include <thrust/functional.h>
+#include <thrust/transform.h>
+
+// The kernels one at a time over a range of shapes: time per call, the
+// effective bandwidth of the bytes a call has to read and write, and that
+// bandwidth as a percentage of a plain copy of the same size. Builds for
+// the device (make bench_kernels) and for the host backends
+// (make bench_kernels_omp, -DQUAKINS_HOST), so CPU-only machines give
+// baselines of their own.
+//
+//   bench_kernels [n_rep] [csv]
+
+using Real = float;
+using namespace quakins::bench;
+
+template <std::size_t dim>
+std::string shape_of(std::array<std::size_t,dim> n) {
+	std::string s;
+	for (std::size_t i=0; i<dim; i++) s += (i? "x":"") + std::to_string(n[i]);
+	return s;
+}
+
+// the advection along x1 of f in the CoordinateSystem layout, in place
+// and out of place with the density
+template <std::size_t dim>
+void bench_free_stream(std::array<std::size_t,dim> n, std::size_t nBd) {
+
+	std::array<std::size_t,dim> nb{}; nb[0] = nBd;
+	std::array<Real,2*dim> range;
+	for (std::size_t i=0; i<dim; i++) {
+		range[2*i] = i<dim/2? 0 : -6;
+		range[2*i+1] = i<dim/2? 20 : 6;
+	}
+	quakins::CoordinateSystem<Real,dim> coord(n,nb,range);
+	std::size_t n_tot = 1, n_space = 1;
+	for (std::size_t i=0; i<dim; i++) {
+		n_tot *= coord.nzTot[i];
+		if (i<dim/2) n_space *= coord.nzTot[i];
+	}
+
+	quakins::fbm::FreeStreamSolver<Real,dim,0> solver(coord,0.01);
+	thrust::device_vector<Real> f(n_tot,1), g(n_tot), dens(n_space);
+
+	measure("FreeStreamSolver",shape_of(coord.nzTot),n_tot,
+					2*n_tot*sizeof(Real),[&]{ solver(f.begin()); });
+	measure("FreeStreamSolver+density",shape_of(coord.nzTot),n_tot,
+					2*n_tot*sizeof(Real),
+					[&]{ solver.advect_with_density(f.begin(),g.begin(),dens.begin()); });
+}
+
+#ifdef QUAKINS_HOST
+// every line kernel the CPU runs against the thrust lambdas, advecting 
+// axis ndim in place and out of place with the density: the largest
+// difference to the thrust result, then the time
+template <std::size_t dim, std::size_t ndim>
+void bench_line_kernels(std::array<std::size_t,dim> n, std::size_t nBd) {
+
+	std::array<std::size_t,dim> nb{}; nb[ndim] = nBd;
+	std::array<Real,2*dim> range;
+	for (std::size_t i=0; i<dim; i++) {
+		range[2*i] = i<dim/2? 0 : -6;
+		range[2*i+1] = i<dim/2? 20 : 6;
+	}
+	quakins::CoordinateSystem<Real,dim> coord(n,nb,range);
+	std::size_t n_tot = 1, n_space = 1;
+	for (std::size_t i=0; i<dim; i++) {
+		n_tot *= coord.nzTot[i];
+		if (i<dim/2) n_space *= coord.nzTot[i];
+	}
+
+	quakins::fbm::FreeStreamSolver<Real,dim,ndim> solver(coord,0.01);
+	thrust::device_vector<Real> f0(n_tot), f(n_tot), g(n_tot), dens(n_space);
+	thrust::host_vector<Real> ref_f, ref_g, ref_dens;
+	thrust::transform(thrust::make_counting_iterator<std::size_t>(0),
+										thrust::make_counting_iterator(n_tot),f0.begin(),
+										[](std::size_t i) { return std::sin(.37f*i)+1.5f; });
+
+	std::vector<std::string> names{"thrust"};
+	for (auto& [name,factory] : 
+			 Proxy<quakins::fbm::LineAdvector<Real>>::Instance().regedit) 
+		if (std::unique_ptr<quakins::fbm::LineAdvector<Real>>
+				(factory->produce())->supported()) names.push_back(name);
+
+	std::string shape = shape_of(coord.nzTot)+" x"+std::to_string(ndim+1);
+	for (auto& name : names) {
+		solver.select_kernel(name);
+		f = f0; solver(f.begin());
+		solver.advect_with_density(f0.begin(),g.begin(),dens.begin());
+
+		thrust::host_vector<Real> hf = f, hg = g, hdens = dens;
+		if (name=="thrust") { ref_f = hf; ref_g = hg; ref_dens = hdens; }
+		double diff = 0;
+		for (std::size_t i=0; i<n_tot; i++)
+			diff = std::max({diff,(double)std::abs(hf[i]-ref_f[i]),
+											 (double)std::abs(hg[i]-ref_g[i])});
+		for (std::size_t i=0; i<n_space; i++)
+			diff = std::max(diff,(double)std::abs(hdens[i]-ref_dens[i]));
+		std::cout << "  " << name << " vs thrust: "
+							<< (diff==0? std::string("bit-identical")
+												 : "max difference "+std::to_string(diff)) << std::endl;
+
+		measure("FreeStreamSolver["+name+"]",shape,n_tot,
+						2*n_tot*sizeof(Real),[&]{ solver(f.begin()); });
+		measure("+density["+name+"]",shape,n_tot,2*n_tot*sizeof(Real),
+						[&]{ solver.advect_with_density(f.begin(),g.begin(),dens.begin()); });
+	}
+}
+#endif
+
+// the permutation of order, as a full index table, generated from
+// per-axis tables, as a scatter and as the piecewise plan
+template <std::size_t dim, std::size_t n_tot>
+void bench_reorder(std::array<std::size_t,dim> n,
+									 std::array<std::size_t,dim> order) {
+
+	std::string shape = shape_of(n)+" "+shape_of(order);
+	std::size_t bytes = 2*n_tot*sizeof(Real);
+	thrust::device_vector<Real> in(n_tot), out(n_tot);
+	thrust::sequence(in.begin(),in.end());
+
+	quakins::ReorderCopy<Real,dim,true,thrust::device_vector> table(n,order);
+	measure("ReorderCopy",shape,n_tot,bytes,
+					[&]{ table(in.begin(),out.begin()); });
+
+	quakins::CompactReorderCopy<Real,dim,true,thrust::device_vector>
+		compact(n,order);
+	measure("CompactReorderCopy",shape,n_tot,bytes,
+					[&]{ compact(in.begin(),out.begin()); });
+
+	quakins::MemSaveReorderCopy<Real,dim,n_tot> mem_save(order,n);
+	measure("MemSaveReorderCopy",shape,n_tot,bytes,
+					[&]{ mem_save(in.begin(),out.begin()); });
+
+	// the piecewise plan, one piece per stream
+	constexpr std::size_t n_piece = 4;
+	using namespace quakins::piecewise_reorder_copy;
+	stream_set streams(n_piece);
+	plan<thrust::device_vector,std::size_t,dim,
+			 decltype(in.begin()),decltype(out.begin()),true>
+		piecewise(streams.data(),n_piece,n,order,in.begin(),out.begin());
+	measure("piecewise plan",shape,n_tot,bytes,[&]{ piecewise(); });
+}
+
+// the velocity integral, with keys and fused, for the {x,v} layout
+template <std::size_t nx, std::size_t nv>
+void bench_density() {
+
+	std::string shape = std::to_string(nx)+"x"+std::to_string(nv);
+	std::size_t n_tot = nx*nv;
+	std::size_t bytes = (n_tot+nx)*sizeof(Real);
+	thrust::device_vector<Real> f(n_tot,1), dens(nx);
+
+	// keyed, contiguous velocity segments
+	quakins::DensityReducer<Real,nv,nx,thrust::device_vector> keyed(-6,6);
+	measure("DensityReducer",shape,n_tot,bytes,
+					[&]{ keyed(f.begin(),dens.begin()); });
+
+	quakins::FusedDensityReducer<Real,nx,false,nv> fused({-6,6});
+	measure("FusedDensityReducer",shape,n_tot,bytes,
+					[&]{ fused(f.begin(),dens.begin()); });
+}
+
+// n_batch periodic fields of n cells
+void bench_poisson(std::size_t n, std::size_t n_batch) {
+
+	std::size_t nBd = 2, n_field = n+2*nBd;
+	thrust::device_vector<Real> dens(n_field*n_batch,1), pot(n_field*n_batch);
+	quakins::FFTPoissonSolver1D<Real,thrust::device_vector>
+		solver(n,nBd,20,n_batch);
+	measure("FFTPoissonSolver1D",std::to_string(n)+" x"+std::to_string(n_batch),
+					n_field*n_batch,2*n_field*n_batch*sizeof(Real),
+					[&]{ solver(dens,pot); });
+}
+
+
+int main(int argc, char* argv[]) {
+
+	n_rep = argc>1? std::stoi(argv[1]) : 20;
+
+	std::cout << std::left << std::setw(28) << "kernel" << std::setw(22)
+						<< "shape" << std::right << std::setw(13) << "time"
+						<< std::setw(17) << "bandwidth" << std::setw(12) << "of copy"
+						<< std::endl;
+
+	bench_free_stream<2>({256,128},6);
+	bench_free_stream<2>({500,256},6);      // main_1d.cu
+	bench_free_stream<2>({2048,512},6);
+	bench_free_stream<4>({32,32,32,32},4);
+	bench_free_stream<4>({100,80,66,60},4); // main_2d.cu
+
+#ifdef QUAKINS_HOST
+	// QUAKINS_SIMD picks the kernel of the runs above
+	bench_line_kernels<2,0>({500,256},6);
+	bench_line_kernels<2,0>({2048,512},6);
+	bench_line_kernels<4,0>({100,80,66,60},4);
+	bench_line_kernels<4,1>({100,80,66,60},4);
+#endif
+
+	bench_reorder<2,512*256>({512,256},{1,0});
+	bench_reorder<2,2048*1024>({2048,1024},{1,0});
+	bench_reorder<4,108*88*66*60>({108,88,66,60},{2,3,0,1});
+
+	bench_density<512,256>();
+	bench_density<4096,512>();
+
+	bench_poisson(512,1);
+	bench_poisson(512,1024);
+	bench_poisson(4096,256);
+
+	if (argc>2) {
+		std::ofstream csv(argv[2]);
+		csv << "kernel,shape,ms,GB/s,percent_of_copy\n";
+		for (auto& r : results)
+			csv << r.kernel << "," << r.shape << "," << r.ms << ","
+					<< r.GBps << "," << r.of_copy << "\n";
+	}
+}
@@ -0,0 +1,107 @@
+#include <iostream>
+#include <chrono>
+#include <cmath>
+#include <vector>
+#include <memory>
+#include "Bench.hpp"
+#include "PoissonSolver1D.hpp"
+#include "PoissonSolver2D.hpp"
+#include <thrust/device_vector.h>
+#include <thrust/transform.h>
+#include <thrust/fill.h>
+
+using Real = float;
+using quakins::bench::time_ms;
+
+// time to solution of the periodic FFT solver against the Thomas one
+// on the same grid, n_batch fields of n cells
+void compare_1d(std::size_t n, std::size_t nBd, std::size_t n_batch, 
+								int n_rep) {
+
+	Real L = 20;
+	std::size_t n_field = n+2*nBd;
+	thrust::device_vector<Real> dens(n_batch*n_field), pot(n_batch*n_field);
+	thrust::transform(thrust::make_counting_iterator<std::size_t>(0),
+										thrust::make_counting_iterator(dens.size()),dens.begin(),
+		[=](std::size_t i) { return std::sin(2*M_PI*(i%n_field)/n); });
+
+	quakins::FFTPoissonSolver1D<Real,thrust::device_vector> 
+		fft(n,nBd,L,n_batch);
+	quakins::ThomasPoissonSolver1D<Real,thrust::device_vector> 
+		thomas(n,nBd,L,n_batch);
+
+	double t_fft = time_ms([&]{ fft(dens,pot); },n_rep);
+	thrust::fill(pot.begin(),pot.end(),0);
+	double t_th = time_ms([&]{ thomas(dens,pot); },n_rep);
+
+	std::cout << "1d " << n << " x" << n_batch << ": fft " << t_fft 
+						<< "ms, thomas " << t_th << "ms" << std::endl;
+}
+
+// the same for the 2D FFT and multigrid solvers; multigrid is timed
+// from a zero initial guess (cold) and from the last solution (warm), 
+// as in a time loop
+void compare_2d(std::size_t n1, std::size_t n2, std::size_t nBd, int n_rep) {
+
+	Real L1 = 20, L2 = 20;
+	std::size_t n_field = (n1+2*nBd)*(n2+2*nBd);
+	thrust::device_vector<Real> dens(n_field), pot(n_field);
+	thrust::transform(thrust::make_counting_iterator<std::size_t>(0),
+										thrust::make_counting_iterator(n_field),dens.begin(),
+		[=](std::size_t i) { 
+			return std::sin(2*M_PI*(i%(n1+2*nBd))/n1)
+						*std::sin(2*M_PI*(i/(n1+2*nBd))/n2); });
+
+	quakins::FFTPoissonSolver2D<Real,thrust::device_vector> 
+		fft({n1,n2},{nBd,nBd},{L1,L2});
+	quakins::MultigridPoissonSolver2D<Real,thrust::device_vector> 
+		mg({n1,n2},{nBd,nBd},{L1,L2});
+
+	double t_fft = time_ms([&]{ fft(dens,pot); },n_rep);
+	double t_cold = time_ms([&]{ 
+		thrust::fill(pot.begin(),pot.end(),0); mg(dens,pot); },n_rep);
+	std::size_t n_cold = mg.n_cycle();
+	double t_warm = time_ms([&]{ mg(dens,pot); },n_rep);
+
+	std::cout << "2d " << n1 << "x" << n2 << ": fft " << t_fft 
+						<< "ms, multigrid cold " << t_cold << "ms (" << n_cold 
+						<< " V-cycles), warm " << t_warm << "ms (" << mg.n_cycle()
+						<< " V-cycles)" << std::endl;
+}
+
+// building n_solver FFT solvers of one shape, as a parameter sweep does:
+// the first one plans, the others get the cached plan
+void compare_setup(std::size_t n1, std::size_t n2, std::size_t nBd,
+									 std::size_t n_solver) {
+
+	using Solver = quakins::FFTPoissonSolver2D<Real,thrust::device_vector>;
+	std::vector<std::unique_ptr<Solver>> solvers;
+	auto make = [&]{
+		auto t1 = std::chrono::steady_clock::now();
+		solvers.push_back(std::make_unique<Solver>(
+			std::array<std::size_t,2>{n1,n2},std::array<std::size_t,2>{nBd,nBd},
+			std::array<Real,2>{20,20}));
+		quakins::backend::synchronize();
+		auto t2 = std::chrono::steady_clock::now();
+		return std::chrono::duration<double,std::milli>(t2-t1).count();
+	};
+	double t_first = make(), t_rest = 0;
+	for (std::size_t i=1; i<n_solver; i++) t_rest += make();
+
+	std::cout << "setup " << n1 << "x" << n2 << ": first " << t_first
+						<< "ms, cached " << t_rest/(n_solver-1) << "ms, " 
+						<< quakins::FFTPlanCache<Real,2>::instance().size() 
+						<< " plan(s) for " << n_solver << " solvers" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+
+	int n_rep = argc>1? std::stoi(argv[1]) : 20;
+
+	compare_1d(500,6,1,n_rep);     // main_1d.cu
+	compare_1d(512,2,1024,n_rep);
+	compare_2d(100,80,4,n_rep);    // main_2d.cu
+	compare_2d(256,256,2,n_rep);
+	compare_setup(512,512,2,16);
+
+}
@@ -0,0 +1,162 @@
+#include <iostream>
+#include <cstdint>
+#include "Bench.hpp"
+#include "MemSaveReorderCopy.hpp"
+#include "TiledReorderCopy.hpp"
+#include "ReorderCopy.hpp"
+#include "MomentReducer.hpp"
+#include "reorder_copy.h"
+#include <thrust/device_vector.h>
+#include <thrust/sequence.h>
+#include <thrust/copy.h>
+#include <thrust/equal.h>
+#include <thrust/reduce.h>
+#include <thrust/functional.h>
+
+using Real = float;
+using quakins::bench::time_ms;
+
+// times the scatter based reorder copy, with a runtime and a compile-time
+// shape, and the tiled one next to a plain copy of the same size, and 
+// checks that they give the same array
+template <std::size_t dim, std::size_t n_tot, typename layout_type>
+void compare(std::string name, std::array<std::size_t,dim> order,
+						 std::array<std::size_t,dim> n_dim, int n_rep) {
+
+	quakins::MemSaveReorderCopy<Real,dim,n_tot,quakins::Layout<dim>> 
+		scatter_copy(order,n_dim);
+	quakins::MemSaveReorderCopy<Real,dim,n_tot,layout_type> 
+		static_copy(order,n_dim);
+	quakins::TiledReorderCopy<Real,dim> tiled_copy(order,n_dim);
+
+	thrust::device_vector<Real> in(n_tot), out1(n_tot), out2(n_tot);
+	thrust::sequence(in.begin(),in.end());
+
+	double t_cp = time_ms([&]{ thrust::copy(in.begin(),in.end(),out1.begin()); },
+												n_rep);
+	double t_sc = time_ms([&]{ scatter_copy(in.begin(),out1.begin()); },n_rep);
+	double t_ss = time_ms([&]{ static_copy(in.begin(),out1.begin()); },n_rep);
+	double t_ti = time_ms([&]{ tiled_copy(in.begin(),out2.begin()); },n_rep);
+
+	auto GBps = [&](double ms) { return tiled_copy.bytes()/ms/1.e6; };
+	bool exact = thrust::equal(out1.begin(),out1.end(),out2.begin());
+
+	std::cout << name << ": copy " << GBps(t_cp) << "GB/s, scatter "
+						<< GBps(t_sc) << "GB/s (static shape " << GBps(t_ss) 
+						<< "GB/s), tiled " << GBps(t_ti) << "GB/s ("
+						<< 100.*t_cp/t_ti << "% of copy), "
+						<< (exact? "exact":"MISMATCH") << std::endl;
+}
+
+
+// the gather/scatter ReorderCopy with its full index table against the
+// one generating the permutation from per-axis tables
+template <std::size_t dim, bool piter_on_origin>
+void compare_gather(std::string name, std::array<std::size_t,dim> order,
+						 				std::array<std::size_t,dim> n_dim, int n_rep) {
+
+	quakins::ReorderCopy<Real,dim,piter_on_origin,
+		thrust::device_vector> table_copy(n_dim,order);
+	quakins::CompactReorderCopy<Real,dim,piter_on_origin,
+		thrust::device_vector> compact_copy(n_dim,order);
+
+	std::size_t n_tot = thrust::reduce(n_dim.begin(),n_dim.end(),1,
+											thrust::multiplies<std::size_t>());
+	thrust::device_vector<Real> in(n_tot), out1(n_tot), out2(n_tot);
+	thrust::sequence(in.begin(),in.end());
+
+	double t_ta = time_ms([&]{ table_copy(in.begin(),out1.begin()); },n_rep);
+	double t_co = time_ms([&]{ compact_copy(in.begin(),out2.begin()); },n_rep);
+	bool exact = thrust::equal(out1.begin(),out1.end(),out2.begin());
+
+	std::cout << name << (piter_on_origin? " gather":" scatter") 
+						<< ": table " << t_ta << "ms (" 
+						<< table_copy.memory_footprint()/1048576. << "MB), compact " 
+						<< t_co << "ms (" << compact_copy.memory_footprint() << "B), "
+						<< (exact? "exact":"MISMATCH") << std::endl;
+}
+
+
+// a step that needs f transposed, here for the moments in the v-inner
+// layout: the transpose in n_piece pieces, each reduced while the next is
+// copied, against the whole transpose and then the reduction, and against
+// the moments taken from the natural layout with no transpose at all
+void compare_pipeline(std::size_t n_piece, int n_rep) {
+
+	constexpr std::size_t nx1 = 100, nx2 = 80, nv1 = 66, nv2 = 60;
+	constexpr std::size_t n1 = nx1+8, n2 = nx2+8, n_seg = nv1*nv2;
+	quakins::CoordinateSystem<Real,4> coord({nx1,nx2,nv1,nv2},{4,4,0,0},
+																					{0,20,0,20,-6,6,-6,6});
+	thrust::device_vector<Real> f(n1*n2*n_seg), g(f.size());
+	thrust::sequence(f.begin(),f.end());
+
+	namespace piecewise = quakins::piecewise_reorder_copy;
+	piecewise::stream_set streams(n_piece);
+	piecewise::plan<thrust::device_vector,std::uint32_t,4,
+		decltype(f.begin()),decltype(g.begin()),true>
+		transpose(streams.data(),n_piece,{n1,n2,nv1,nv2},{2,3,0,1},
+							f.begin(),g.begin(),n_seg);
+	quakins::MomentReducer<Real,4,true> moments_t(coord);
+	quakins::MomentReducer<Real,4,false> moments(coord);
+
+	auto reduce_piece = [&](std::size_t begin, std::size_t end) {
+		moments_t(g.begin(),begin/n_seg,end/n_seg);
+	};
+	piecewise::overlap o{};
+	for (int i=0; i<n_rep; i++) {
+		auto r = piecewise::measure_overlap(transpose,reduce_piece,
+			[&]{ transpose(); moments_t(g.begin()); });
+		o.transpose += r.transpose/n_rep; o.compute += r.compute/n_rep;
+		o.pipelined += r.pipelined/n_rep; o.serial += r.serial/n_rep;
+	}
+	double t_nat = time_ms([&]{ moments(f.begin()); },n_rep);
+
+	std::cout << "2d2v {2,3,0,1} + moments, " << n_piece << " pieces: transpose "
+						<< o.transpose << "ms, moments " << o.compute << "ms, one after"
+						<< " the other " << o.serial << "ms, pipelined " << o.pipelined
+						<< "ms (x" << o.speedup() << ", " << int(100*o.hidden())
+						<< "% of the shorter hidden); no transpose " << t_nat << "ms"
+						<< std::endl;
+}
+
+
+int main(int argc, char* argv[]) {
+
+	int n_rep = argc>1? std::stoi(argv[1]) : 20;
+
+	using quakins::StaticLayout;
+
+	// main_1d.cu
+	compare<2,512*256,StaticLayout<512,256>>(
+		"1d1v {1,0}",{1,0},{512,256},n_rep);
+	compare<2,512*256,StaticLayout<256,512>>(
+		"1d1v {1,0} back",{1,0},{256,512},n_rep);
+
+	// main_2d.cu
+	constexpr std::size_t n_2d = 108*88*66*60;
+	compare<4,n_2d,StaticLayout<108,88,66,60>>(
+		"2d2v {2,3,0,1}",{2,3,0,1},{108,88,66,60},n_rep);
+	compare<4,n_2d,StaticLayout<108,88,66,60>>(
+		"2d2v {0,1,3,2}",{0,1,3,2},{108,88,66,60},n_rep);
+	compare<4,n_2d,StaticLayout<108,88,60,66>>(
+		"2d2v {1,0,3,2}",{1,0,3,2},{108,88,60,66},n_rep);
+	compare<4,n_2d,StaticLayout<88,108,66,60>>(
+		"2d2v {2,3,1,0}",{2,3,1,0},{88,108,66,60},n_rep);
+
+	// other ranks
+	compare<3,64*128*96,StaticLayout<64,128,96>>(
+		"3d {2,0,1}",{2,0,1},{64,128,96},n_rep);
+	compare<5,16*12*20*10*14,StaticLayout<16,12,20,10,14>>(
+		"5d {4,2,0,3,1}",{4,2,0,3,1},{16,12,20,10,14},n_rep);
+	compare<6,8*10*6*12*7*9,StaticLayout<8,10,6,12,7,9>>(
+		"6d {5,4,3,2,1,0}",{5,4,3,2,1,0},{8,10,6,12,7,9},n_rep);
+
+	compare_gather<2,true>("1d1v {1,0}",{1,0},{512,256},n_rep);
+	compare_gather<2,false>("1d1v {1,0}",{1,0},{512,256},n_rep);
+	compare_gather<4,true>("2d2v {2,3,0,1}",{2,3,0,1},{108,88,66,60},n_rep);
+	compare_gather<4,false>("2d2v {2,3,0,1}",{2,3,0,1},{108,88,66,60},n_rep);
+
+	compare_pipeline(4,n_rep);
+	compare_pipeline(8,n_rep);
+
+}
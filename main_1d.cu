@@ -2,12 +2,16 @@
 #include <complex>
 #include <cmath>
 #include <fstream>
+#include <optional>
+#include "Backend.hpp"
 #include "FreeStreamSolver.hpp"
 #include "PoissonSolver1D.hpp"
+#include "AccelerationSolver.hpp"
+#include "WignerSolver.hpp"
 #include "Timer.h"
-#include "MemSaveReorderCopy.hpp"
-#include "DensityReducer.hpp"
 #include "PhaseSpaceInitialization.hpp"
+#include "Snapshot.hpp"
+#include "Profiler.hpp"
 #include <thrust/functional.h>
 #include <thrust/transform.h>
 #include <thrust/sequence.h>
@@ -27,11 +31,13 @@ constexpr Real v1Max =  6;
 constexpr Real v1Min = -6;
 
 constexpr Real dt = (x1Max-x1Min)/nx1/v1Max/2.3;
+// > 0 for the quantum (Wigner) velocity term, 0 for the Vlasov one
+constexpr Real hbar = 0;
 
 
 
 int main(int argc, char* argv[]) {
-	cudaSetDevice(1);
+	if (!quakins::backend::select_device()) return 1;
 	std::cout << "dt=" << dt << std::endl;
 	Timer timer;
 	
@@ -54,60 +60,87 @@ int main(int argc, char* argv[]) {
 
 	quakins::fbm::FreeStreamSolver<Real,2,0> 
 					fbmSolverX1(_coord,dt*.5);	
+	quakins::fbm::AccelerationSolver<Real,2,1> 
+					fbmSolverV1(_coord,dt);
+	// its FFT plans and buffers only for the quantum run
+	std::optional<quakins::fbm::WignerSolver<Real,2>> wignerSolverV1;
+	if constexpr (hbar>0) wignerSolverV1.emplace(_coord,dt,hbar);
 	
 	thrust::device_vector<Real> 
 		ion(nTot), ion_buf(nTot),
 		electron(nTot), electron_buf(nTot);
 	
-	timer.tick("Phase space initialization...")
-	quakins::PhaseSpaceInitialization<Real,2> init(&_coord);
+	timer.tick("Phase space initialization...");
+	quakins::PhaseSpaceInitialization<Real,2,
+		quakins::StaticLayout<nx1Tot,nv1>> init(&_coord);
 	init(electron.begin(),f);
 	timer.tock();
 
-	std::ofstream bout("dfbegin",std::ios::out);
-	bout << electron << std::endl;
+	// binary snapshots, written in the background
+	quakins::SnapshotWriter snapshot;
+	snapshot.write("dfbegin",electron.begin(),_coord,{0,1});
 
 
+	// a uniform ion background
 	thrust::device_vector<Real> 
-		dens_e(nx1Tot), dens_i(nx1Tot), potential(nx1Tot);
-
-	quakins::DensityReducer<Real,nv1,nx1Tot,
-					thrust::device_vector> cal_dens(v1Min,v1Max);
+		dens_e(nx1Tot), dens_i(nx1Tot,1.), charge(nx1Tot), 
+		potential(nx1Tot), accel(nx1Tot), energy(nx1Tot);
 
 	quakins::FFTPoissonSolver1D<Real,
 					thrust::device_vector> solvePoisson(nx1,nx1Ghost,x1Max-x1Min);
 
-	quakins::MemSaveReorderCopy<Real,2,nTot> copy1({1,0},{nx1Tot,nv1});
-	quakins::MemSaveReorderCopy<Real,2,nTot> copy2({1,0},{nv1,nx1Tot});
-
-	std::ofstream rho_out("rho",std::ios::out);
-	std::ofstream phi_out("phi",std::ios::out);
 
+	// QUAKINS_PROFILE=prof.json for the time per region
+	auto& prof = quakins::Profiler::instance();
+	std::size_t f_bytes = nTot*sizeof(Real);
 
 	std::cout << "main loop start." << std::endl;
 	for (int step=0; step<100; step++) {
 		
 		timer.tick("step"+std::to_string(step));
 		for (int ie=0; ie<10; ie++) {
-
-			fbmSolverX1(electron.begin(),nx1Tot);
-
-			copy1(electron.begin(),electron_buf.begin());
-			cal_dens(electron_buf.begin(), dens_e.begin());
-
-			solvePoisson(dens_e,potential);
-
-			copy2(electron_buf.begin(),electron.begin());
+			auto region_step = prof.region("step");
+
+			// Strang splitting, x by dt/2, v by dt, x by dt/2; the density 
+			// comes out of the first advection pass itself
+			{
+				auto region = prof.region("advection x + density",2*f_bytes);
+				fbmSolverX1.advect_with_density(electron.begin(),
+					electron_buf.begin(), dens_e.begin());
+				electron.swap(electron_buf);
+			}
+			{
+				auto region = prof.region("Poisson");
+				thrust::transform(dens_i.begin(),dens_i.end(),dens_e.begin(),
+													charge.begin(),thrust::minus<Real>());
+				solvePoisson(charge,potential);
+			}
+
+			// electrons, q/m = -1
+			{
+				auto region = prof.region("advection v",2*f_bytes);
+				if constexpr (hbar>0) {
+					thrust::transform(potential.begin(),potential.end(),
+														energy.begin(),thrust::negate<Real>());
+					(*wignerSolverV1)(electron.begin(),energy);
+				} else {
+					quakins::fbm::acceleration_from_potential(potential.begin(),
+						accel.begin(),nx1,nx1Ghost,_coord.dz[0],Real(-1));
+					fbmSolverV1(electron.begin(),accel.begin());
+				}
+			}
+			{
+				auto region = prof.region("advection x",2*f_bytes);
+				fbmSolverX1(electron.begin(),electron_buf.begin());
+				electron.swap(electron_buf);
+			}
 		}
 		timer.tock();
-		rho_out << dens_e;
-		phi_out << potential;
+		auto region = prof.region("I/O");
+		snapshot.write("rho",dens_e.begin(),_coord,{0},step,10*(step+1)*dt);
+		snapshot.write("phi",potential.begin(),_coord,{0},step,10*(step+1)*dt);
 	}
 
-	std::ofstream out("df",std::ios::out);
-	out << electron << std::endl;
+	snapshot.write("df",electron.begin(),_coord,{0,1},100,1000*dt);
+	prof.write();
 }
-
-
-
-
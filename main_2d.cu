@@ -2,11 +2,16 @@
 #include <complex>
 #include <cmath>
 #include <fstream>
+#include "Backend.hpp"
 #include "FreeStreamSolver.hpp"
 #include "Timer.h"
-#include "MemSaveReorderCopy.hpp"
 #include "PhaseSpaceInitialization.hpp"
 #include "DensityReducer.hpp"
+#include "MomentReducer.hpp"
+#include "PoissonSolver2D.hpp"
+#include "Snapshot.hpp"
+#include "Checkpoint.hpp"
+#include "Profiler.hpp"
 #include <thrust/functional.h>
 #include <thrust/transform.h>
 #include <thrust/sequence.h>
@@ -33,20 +38,17 @@ constexpr Real v1Min = -6,  v2Min = -6;
 
 constexpr Real dt = 0.01;
 
+constexpr std::size_t nStep = 400;
+constexpr std::size_t checkpointEvery = 100;
+
 
 int main(int argc, char* argv[]) {
 
 	Timer timer;
 
 	timer.tick("Asking for GPU memory...");
-	cudaSetDevice(1);
-
-	cudaDeviceSetLimit(
-		cudaLimitMallocHeapSize, 1048576ULL*1024*3);
-	cudaDeviceSetLimit(
-		cudaLimitStackSize, 1048576ULL*1024*3);
-	cudaDeviceSetLimit(
-		cudaLimitPrintfFifoSize, 1048576ULL*1024*3);
+	if (!quakins::backend::select_device()) return 1;
+	quakins::backend::set_device_limits(1048576ULL*1024*3);
 	timer.tock();
 	
 	timer.tick("quakins start...");
@@ -71,67 +73,111 @@ int main(int argc, char* argv[]) {
 	};
 	
 
+	// boundary condition of each spatial dimension
+	std::array<quakins::Boundary<Real>,DIM/2> bd 
+		= {{{quakins::BoundaryType::periodic},
+				{quakins::BoundaryType::periodic}}};
+
 	quakins::fbm::FreeStreamSolver<Real,DIM,0> 
-					fbmSolverX1(_coord,dt*.5);	
+					fbmSolverX1(_coord,dt*.5,bd[0]);	
 	quakins::fbm::FreeStreamSolver<Real,DIM,1> 
-					fbmSolverX2(_coord,dt*.5);
-
-	quakins::MemSaveReorderCopy<Real,DIM,nTot>
-					copy0({0,1,3,2},{nx1Tot,nx2Tot,nv1,nv2});
-	quakins::MemSaveReorderCopy<Real,DIM,nTot>
-					copy1({1,0,3,2},{nx1Tot,nx2Tot,nv2,nv1});
-	quakins::MemSaveReorderCopy<Real,DIM,nTot>
-					copy2({2,3,1,0},{nx2Tot,nx1Tot,nv1,nv2});
-	quakins::MemSaveReorderCopy<Real,DIM,nTot>
-					copy3({2,3,1,0},{nv1,nv2,nx1Tot,nx2Tot});
-
+					fbmSolverX2(_coord,dt*.5,bd[1]);
 
+	// f stays in the {x1,x2,v1,v2} layout of _coord, x1 is advected out
+	// of place into test2 and x2, along its stride, back into test1; the
+	// same pass integrates the density over both velocity axes
 	thrust::device_vector<Real> test1(nTot), test2(nTot);
-	thrust::device_vector<Real> dens_e(nx1Tot*nx2Tot), 
-															dens_e_buf(nx1Tot*nx2Tot*nv2);
+	thrust::device_vector<Real> dens_e(nx1Tot*nx2Tot), potential(nx1Tot*nx2Tot);
 
-	quakins::DensityReducer<Real,nv1,nx1Tot*nx2Tot*nv2,
-		thrust::device_vector> cal_dens_1(v1Min,v1Max);
-	quakins::DensityReducer<Real,nv2,nx1Tot*nx2Tot,
-		thrust::device_vector> cal_dens_2(v2Min,v2Max);
+	quakins::FFTPoissonSolver2D<Real,thrust::device_vector> 
+		solvePoisson({nx1,nx2},{nx1Ghost,nx2Ghost},{x1Max-x1Min,x2Max-x2Min});
+
+	// diagnostics, all moments from one read of f
+	quakins::MomentReducer<Real,DIM,false> cal_moments(_coord);
 
 
 	timer.tock(); /* quakins start... */
 
-	timer.tick("Phase space initialization...");
-	quakins::PhaseSpaceInitialization<Real,DIM> init(&_coord);
-	init(test2.begin(),f);
-	timer.tock();
+	// binary snapshots, written in the background; the spatial fields
+	// are on axes {x1,x2} of _coord. A restart appends to the snapshots
+	// of the run it continues, a fresh run starts them anew
+	quakins::SnapshotWriter snapshot(".",argc>1);
+	std::vector<std::size_t> space{0,1}, phase_space{0,1,2,3};
+
+	// quakins [checkpoint]: restart from a checkpoint instead
+	std::size_t step_begin = 0;
+	if (argc>1) {
+		timer.tick("Restart from "+std::string(argv[1])+"...");
+		quakins::Checkpoint restart;
+		if (!restart.load(argv[1],test1.begin(),_coord,phase_space))
+			return 1;
+		// dt is fixed at compile time, another one is another build
+		if (restart.params["dt"]!=dt) {
+			std::cerr << std::endl << argv[1] << " was written with dt " 
+								<< restart.params["dt"] << ", this build has " << dt << std::endl;
+			return 1;
+		}
+		step_begin = restart.step()+1;
+		timer.tock();
+	} else {
+		timer.tick("Phase space initialization...");
+		quakins::PhaseSpaceInitialization<Real,DIM,
+			quakins::StaticLayout<nx1Tot,nx2Tot,nv1,nv2>> init(&_coord);
+		init(test1.begin(),f);
+		timer.tock();
+	}
 
-	copy0(test2.begin(),test1.begin());
-	
-	std::ofstream rho_out("rho",std::ios::out);
+	// QUAKINS_PROFILE=prof.json for the time per region
+	auto& prof = quakins::Profiler::instance();
+	std::size_t f_bytes = nTot*sizeof(Real);
 
 	std::cout << "main loop start." << std::endl;
-	for (std::size_t step=0; step<400; step++) {
+	for (std::size_t step=step_begin; step<nStep; step++) {
 		timer.tick("step"+std::to_string(step));	
-
-		fbmSolverX1(test1.begin(),nx1Tot*nx2Tot*nv2);
-		
-		copy1(test1.begin(),test2.begin());
-	
-		fbmSolverX2(test2.begin(),nx1Tot*nx2Tot*nv1);
-		
-		copy2(test2.begin(),test1.begin());
-		
-		cal_dens_1(test1.begin(),dens_e_buf.begin());
-		cal_dens_2(dens_e_buf.begin(),dens_e.begin());
+		auto region_step = prof.region("step");
+
+		{
+			auto region = prof.region("advection x1",2*f_bytes);
+			fbmSolverX1(test1.begin(),test2.begin());
+		}
+		{
+			auto region = prof.region("advection x2 + density",2*f_bytes);
+			fbmSolverX2.advect_with_density(test2.begin(),test1.begin(),
+																			dens_e.begin());
+		}
+		{
+			auto region = prof.region("Poisson");
+			solvePoisson(dens_e,potential);
+		}
 		
-		if (step%10==0)
-			rho_out << dens_e << std::endl;
+		if (step%10==0) {
+			Real time = (step+1)*dt;
+			{
+				auto region = prof.region("moments",f_bytes);
+				cal_moments(test1.begin());
+			}
+			auto region = prof.region("I/O");
+			snapshot.write("rho",dens_e.begin(),_coord,space,step,time);
+			snapshot.write("phi",potential.begin(),_coord,space,step,time);
+			snapshot.write("j1",cal_moments.current(0).begin(),_coord,space,step,time);
+			snapshot.write("j2",cal_moments.current(1).begin(),_coord,space,step,time);
+			snapshot.write("energy",cal_moments.energy().begin(),_coord,space,step,time);
+			snapshot.write("q1",cal_moments.heat_flux(0).begin(),_coord,space,step,time);
+			snapshot.write("q2",cal_moments.heat_flux(1).begin(),_coord,space,step,time);
+		}
+
+		// f after the step, written while the next steps run
+		if ((step+1)%checkpointEvery==0) {
+			auto region = prof.region("checkpoint",f_bytes);
+			quakins::Checkpoint::save(snapshot,"checkpoint.qkc",test1.begin(),
+				_coord,phase_space,step,(step+1)*dt,{{"dt",dt}});
+		}
 
-		copy3(test1.begin(),test2.begin());
-		test1 = test2;
 		timer.tock();
 	}
 
-	std::ofstream out("df",std::ios::out);
-	out << test1 << std::endl;
+	snapshot.write("df",test1.begin(),_coord,phase_space,nStep,nStep*dt);
+	prof.write();
 	
 }
 
@@ -0,0 +1,145 @@
+#include <iostream>
+#include <cmath>
+#include <string>
+#include "Backend.hpp"
+#include "FreeStreamSolver.hpp"
+#include "PoissonSolver1D.hpp"
+#include "AccelerationSolver.hpp"
+#include "MomentReducer.hpp"
+#include "Timer.h"
+#include "PhaseSpaceInitialization.hpp"
+#include "Snapshot.hpp"
+#include "Decomposition.hpp"
+#include "Transport.hpp"
+#include <thrust/functional.h>
+#include <thrust/transform.h>
+#include <thrust/reduce.h>
+
+// main_1d.cu (Vlasov) with x split across ranks: the ghost zones of every
+// rank are the neighbours' cells, exchanged while the interior cells are
+// advected. The density is gathered for the Poisson equation, which every
+// rank solves on the full grid before taking its part of the field.
+//
+//   quakins_domain [n_rank=2] [shm|thread]
+//
+// shm forks one process per rank, each on its own GPU (QUAKINS_DEVICE
+// is the first); thread runs the ranks as threads of one process, which
+// on the device backend share one GPU.
+
+using Real = float;
+
+constexpr std::size_t nx1 = 500;
+constexpr std::size_t nv1 = 256;
+constexpr std::size_t nx1Ghost = 6;
+constexpr std::size_t nx1Tot = nx1Ghost*2+nx1;
+
+constexpr Real x1Max =  20;
+constexpr Real x1Min =  0;
+constexpr Real v1Max =  6;
+constexpr Real v1Min = -6;
+
+constexpr Real dt = (x1Max-x1Min)/nx1/v1Max/2.3;
+
+
+void run(quakins::Transport& transport) {
+
+	int rank = transport.rank();
+	bool root = rank==0;
+	Timer timer;
+
+	quakins::CoordinateSystem<Real,2>
+					_coord({nx1,nv1}, {nx1Ghost,0},
+								 {x1Min,x1Max, v1Min,v1Max});
+	quakins::SpatialDomain<Real,2> domain(_coord,rank,transport.size());
+	auto& coord = domain.coord;
+	std::size_t nTot = coord.nzTot[0]*coord.nzTot[1];
+	std::cout << "rank " << rank << ": x cells " << domain.lo << " to "
+						<< domain.hi << std::endl;
+
+	auto f = [](std::array<Real,2> z) -> Real {
+		auto fx = [](Real x1) {
+			return 1.+.1*std::cos(2.*M_PI/x1Max*x1);
+		};
+		auto fv = [](Real v1) {
+			return std::exp(-std::pow(v1,2)/2.)/std::sqrt(2.*M_PI);
+		};
+		return static_cast<Real>(fx(z[0])*fv(z[1]));
+	};
+
+	// the ghosts along x are the neighbours'
+	quakins::fbm::FreeStreamSolver<Real,2,0>
+					fbmSolverX1(coord,dt*.5,{quakins::BoundaryType::external});
+	quakins::fbm::AccelerationSolver<Real,2,1> fbmSolverV1(coord,dt);
+	quakins::HaloExchange<Real,2> halo(transport,domain);
+	quakins::MomentReducer<Real,2,false> cal_density(coord,quakins::moment::density);
+
+	thrust::device_vector<Real> electron(nTot), electron_buf(nTot);
+	quakins::PhaseSpaceInitialization<Real,2> init(&coord);
+	init(electron.begin(),f);
+
+	// the fields on the full grid, the same on every rank
+	thrust::device_vector<Real>
+		dens_e(nx1Tot), dens_i(nx1Tot,1.), charge(nx1Tot),
+		potential(nx1Tot), accel_full(nx1Tot), accel(coord.nzTot[0]);
+
+	quakins::FFTPoissonSolver1D<Real,
+					thrust::device_vector> solvePoisson(nx1,nx1Ghost,x1Max-x1Min);
+
+	// x by dt/2, the ghosts arriving while the interior cells move
+	auto advect_x = [&] {
+		halo.start(electron.begin());
+		fbmSolverX1.advect_interior(electron.begin(),electron_buf.begin());
+		halo.finish(electron.begin());
+		fbmSolverX1.advect_edges(electron.begin(),electron_buf.begin());
+		electron.swap(electron_buf);
+	};
+
+	quakins::SnapshotWriter snapshot;
+
+	if (root) std::cout << "main loop start." << std::endl;
+	for (int step=0; step<100; step++) {
+
+		if (root) timer.tick("step"+std::to_string(step));
+		for (int ie=0; ie<10; ie++) {
+
+			// Strang splitting, x by dt/2, v by dt, x by dt/2
+			advect_x();
+
+			cal_density(electron.begin());
+			domain.allgather(transport,cal_density.density().begin(),dens_e,_coord);
+			thrust::transform(dens_i.begin(),dens_i.end(),dens_e.begin(),
+												charge.begin(),thrust::minus<Real>());
+			solvePoisson(charge,potential);
+
+			// electrons, q/m = -1
+			quakins::fbm::acceleration_from_potential(potential.begin(),
+				accel_full.begin(),nx1,nx1Ghost,_coord.dz[0],Real(-1));
+			domain.scatter(accel_full,accel.begin(),_coord);
+			fbmSolverV1(electron.begin(),accel.begin());
+
+			advect_x();
+		}
+		if (root) {
+			timer.tock();
+			snapshot.write("rho",dens_e.begin(),_coord,{0},step,10*(step+1)*dt);
+			snapshot.write("phi",potential.begin(),_coord,{0},step,10*(step+1)*dt);
+		}
+	}
+
+	// every rank its own cells, with their x coordinates in the header
+	snapshot.write("df.r"+std::to_string(rank),electron.begin(),coord,{0,1},
+								 100,1000*dt);
+	if (root)
+		std::cout << "mass " << thrust::reduce(dens_e.begin()+nx1Ghost,
+																					 dens_e.end()-nx1Ghost)*_coord.dz[0]
+							<< std::endl;
+}
+
+
+int main(int argc, char* argv[]) {
+
+	int n_rank = argc>1? std::stoi(argv[1]) : 2;
+	std::string kind = argc>2? argv[2] :
+		quakins::backend::on_device? "shm" : "thread";
+	return quakins::run_ranks(n_rank,kind,run);
+}
@@ -0,0 +1,127 @@
+#include <iostream>
+#include <cmath>
+#include <string>
+#include <vector>
+#include "Backend.hpp"
+#include "FreeStreamSolver.hpp"
+#include "Timer.h"
+#include "PhaseSpaceInitialization.hpp"
+#include "PoissonSolver2D.hpp"
+#include "Snapshot.hpp"
+#include "Decomposition.hpp"
+#include "Transport.hpp"
+#include <thrust/reduce.h>
+
+// main_2d.cu with the v2 axis split across ranks: every rank advects its
+// velocity slab in x1 and x2 without communication, the partial
+// densities are allreduced and every rank solves the Poisson equation.
+//
+//   quakins_slab [n_rank=2] [shm|thread]
+//
+// shm forks one process per rank, each on its own GPU (QUAKINS_DEVICE
+// is the first); thread runs the ranks as threads of one process, which
+// on the device backend share one GPU.
+
+using Real = float;
+
+constexpr std::size_t DIM = 4;
+
+constexpr std::size_t nx1 = 100;
+constexpr std::size_t nx2 = 80;
+constexpr std::size_t nv1 = 66;
+constexpr std::size_t nv2 = 60;
+constexpr std::size_t nx1Ghost = 4;
+constexpr std::size_t nx2Ghost = 4;
+constexpr std::size_t nx1Tot = nx1Ghost*2+nx1;
+constexpr std::size_t nx2Tot = nx2Ghost*2+nx2;
+
+constexpr Real x1Max =  20, x2Max =  20;
+constexpr Real x1Min =  0,  x2Min =  0;
+constexpr Real v1Max =  6,  v2Max =  6;
+constexpr Real v1Min = -6,  v2Min = -6;
+
+constexpr Real dt = 0.01;
+
+constexpr std::size_t nStep = 400;
+
+
+void run(quakins::Transport& transport) {
+
+	int rank = transport.rank();
+	bool root = rank==0;
+	Timer timer;
+
+	quakins::CoordinateSystem<Real,DIM>
+					_coord({nx1,nx2,nv1,nv2},
+								 {nx1Ghost,nx2Ghost,0,0},
+								 {x1Min,x1Max,x2Min,x2Max,
+								  v1Min,v1Max,v2Min,v2Max});
+	quakins::VelocitySlab<Real,DIM> slab(_coord,rank,transport.size());
+	auto& coord = slab.coord;
+	std::cout << "rank " << rank << ": v2 rows " << slab.lo << " to "
+						<< slab.hi << ", " << slab.nTot << " values" << std::endl;
+
+	auto f = [](std::array<Real,DIM> z) {
+		auto fx = [](Real x1, Real x2) {
+			return std::exp(-std::pow(x1-3,2)
+							-std::pow(x2-10,2));
+		};
+		auto fv = [](Real v1, Real v2) {
+			return std::exp(-std::pow(v1+2,2)/2.
+						-std::pow(v2,2)/1.);
+		};
+		return fx(z[0],z[1])*fv(z[2],z[3]);
+	};
+
+	quakins::fbm::FreeStreamSolver<Real,DIM,0> fbmSolverX1(coord,dt*.5);
+	quakins::fbm::FreeStreamSolver<Real,DIM,1> fbmSolverX2(coord,dt*.5);
+
+	thrust::device_vector<Real> test1(slab.nTot), test2(slab.nTot);
+	thrust::device_vector<Real> dens_e(nx1Tot*nx2Tot), potential(nx1Tot*nx2Tot);
+
+	quakins::FFTPoissonSolver2D<Real,thrust::device_vector>
+		solvePoisson({nx1,nx2},{nx1Ghost,nx2Ghost},{x1Max-x1Min,x2Max-x2Min});
+
+	quakins::PhaseSpaceInitialization<Real,DIM> init(&coord);
+	init(test1.begin(),f);
+
+	// the spatial fields are the same on every rank, the first writes them
+	quakins::SnapshotWriter snapshot;
+	std::vector<std::size_t> space{0,1}, phase_space{0,1,2,3};
+
+	if (root) std::cout << "main loop start." << std::endl;
+	for (std::size_t step=0; step<nStep; step++) {
+		if (root) timer.tick("step"+std::to_string(step));
+
+		fbmSolverX1(test1.begin(),test2.begin());
+		fbmSolverX2.advect_with_density(test2.begin(),test1.begin(),
+																		dens_e.begin());
+
+		// the slab's part of the density, then all of it
+		quakins::allreduce(transport,dens_e);
+		solvePoisson(dens_e,potential);
+
+		if (root && step%10==0) {
+			Real time = (step+1)*dt;
+			snapshot.write("rho",dens_e.begin(),_coord,space,step,time);
+			snapshot.write("phi",potential.begin(),_coord,space,step,time);
+		}
+		if (root) timer.tock();
+	}
+
+	// every rank its own slab, with its v2 coordinates in the header
+	snapshot.write("df.r"+std::to_string(rank),test1.begin(),coord,
+								 phase_space,nStep,nStep*dt);
+	if (root)
+		std::cout << "mass " << thrust::reduce(dens_e.begin(),dens_e.end())
+								 *_coord.dz[0]*_coord.dz[1] << std::endl;
+}
+
+
+int main(int argc, char* argv[]) {
+
+	int n_rank = argc>1? std::stoi(argv[1]) : 2;
+	std::string kind = argc>2? argv[2] :
+		quakins::backend::on_device? "shm" : "thread";
+	return quakins::run_ranks(n_rank,kind,run);
+}
@@ -0,0 +1,329 @@
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+#include "Backend.hpp"
+#include "FreeStreamSolver.hpp"
+#include "AccelerationSolver.hpp"
+#include "PoissonSolver1D.hpp"
+#include "Snapshot.hpp"
+#include <thrust/device_vector.h>
+#include <thrust/host_vector.h>
+#include <thrust/transform.h>
+#include <thrust/functional.h>
+
+// Regression gate: small runs of the main_1d.cu and main_2d.cu loops,
+// checked for mass conservation, against the exact free streaming
+// solution and against a recorded df, and timed against a recorded
+// baseline. A run fails on any check beyond its limit, and on a missing
+// reference df unless --allow-missing is given; without a baseline of 
+// this machine the times are skipped.
+//
+//   regress [record|baseline] [--allow-missing] [dir=regress] 
+//           [time tolerance=0.2]
+//
+// The reference df of every run, dir/<run>.qks, is the same on every
+// machine and backend and is kept in the repository. The baseline times,
+// dir/baseline.<backend>.csv, only compare within one machine: 
+// "baseline" writes them for this machine and backend, "record" writes
+// them and the reference df (dir must exist).
+
+using Real = float;
+
+bool record = false, baseline_only = false, allow_missing = false;
+std::string dir = "regress";
+double time_tol = 0.2;
+
+struct Check {
+	std::string config, name;
+	double value, limit;
+	std::string result;
+};
+std::vector<Check> checks;
+
+void check(std::string config, std::string name, double value, double limit) {
+	checks.push_back({config,name,value,limit,value<=limit? "PASS":"FAIL"});
+}
+
+// a record that is not there fails the gate if it is required, unless
+// allowed
+void missing(std::string config, std::string name, std::string why,
+						 bool required = true) {
+	checks.push_back({config,name,0,0,
+		(required && !allow_missing? "FAIL (":"SKIP (")+why+")"});
+}
+
+bool failed(const Check& c) { return c.result.rfind("FAIL",0)==0; }
+
+// the times of this backend, a GPU run says nothing about an OMP one
+std::string baseline_path() {
+	return dir+"/baseline."+quakins::backend::name()+".csv";
+}
+
+std::map<std::string,double> read_baseline() {
+	std::map<std::string,double> ms;
+	std::ifstream is(baseline_path());
+	std::string line;
+	std::getline(is,line); // header
+	while (std::getline(is,line)) {
+		auto comma = line.find(',');
+		if (comma!=std::string::npos)
+			ms[line.substr(0,comma)] = std::stod(line.substr(comma+1));
+	}
+	return ms;
+}
+
+std::map<std::string,double> time_per_step; // of this run
+
+// whether point idx of the layout of coord is off the ghosts
+template <std::size_t dim>
+bool interior(const quakins::CoordinateSystem<Real,dim>& coord,
+							std::size_t idx) {
+	for (std::size_t i=0; i<dim; i++) {
+		std::size_t k = idx%coord.nzTot[i]; idx /= coord.nzTot[i];
+		if (k<coord.nBd[i] || k>=coord.nBd[i]+coord.nz[i]) return false;
+	}
+	return true;
+}
+
+template <std::size_t dim>
+double mass(const quakins::CoordinateSystem<Real,dim>& coord,
+						const thrust::host_vector<Real>& f) {
+	double m = 0;
+	for (std::size_t i=0; i<f.size(); i++) if (interior(coord,i)) m += f[i];
+	return m;
+}
+
+// the L2 norm of f-g over the interior, relative to that of g
+template <std::size_t dim>
+double relative_L2(const quakins::CoordinateSystem<Real,dim>& coord,
+									 const thrust::host_vector<Real>& f,
+									 const thrust::host_vector<Real>& g) {
+	double d = 0, n = 0;
+	for (std::size_t i=0; i<f.size(); i++) if (interior(coord,i)) {
+		d += (f[i]-g[i])*(f[i]-g[i]); n += g[i]*g[i];
+	}
+	return std::sqrt(d/n);
+}
+
+// f(z) at every grid point of coord, ghosts included
+template <std::size_t dim, typename Func>
+thrust::host_vector<Real> sample(const quakins::CoordinateSystem<Real,dim>& coord,
+																 Func func) {
+	std::size_t n_tot = 1;
+	for (auto n : coord.nzTot) n_tot *= n;
+	thrust::host_vector<Real> f(n_tot);
+	for (std::size_t i=0; i<n_tot; i++) f[i] = func(coord[i]);
+	return f;
+}
+
+// the recorded df of config, written in record mode
+template <std::size_t dim>
+void reference(std::string config,
+							 const quakins::CoordinateSystem<Real,dim>& coord,
+							 const thrust::host_vector<Real>& f, double limit) {
+
+	std::vector<std::size_t> order;
+	for (std::size_t i=0; i<dim; i++) order.push_back(i);
+	std::string path = dir+"/"+config+".qks";
+
+	if (baseline_only) return;
+	if (record) {
+		quakins::SnapshotWriter writer;
+		writer.write_file<Real>(path,"",
+			quakins::SnapshotHeader::make("df",coord,order,0,0),f.begin());
+		return;
+	}
+
+	std::ifstream is(path,std::ios::in|std::ios::binary);
+	quakins::SnapshotHeader header;
+	if (!header.read(is)) {
+		missing(config,"L2 vs recorded df","no "+path); return;
+	}
+	auto expected = quakins::SnapshotHeader::make("df",coord,order,0,0);
+	if (header.val_size!=sizeof(Real) || header.n_value()!=expected.n_value()) {
+		check(config,"recorded df shape",1,0); return;
+	}
+	thrust::host_vector<Real> g(header.n_value());
+	is.read(reinterpret_cast<char*>(g.data()),g.size()*sizeof(Real));
+	check(config,"L2 vs recorded df",relative_L2(coord,f,g),limit);
+}
+
+// n_step steps from the state reset() sets up, the best of a few 
+// trials; the last one leaves the state to check
+template <typename Reset, typename Step>
+void timed(std::string config, std::size_t n_step, Reset reset, Step step) {
+	double best = 0;
+	for (int trial=0; trial<5; trial++) {
+		reset();
+		quakins::backend::synchronize();
+		auto t1 = std::chrono::steady_clock::now();
+		for (std::size_t s=0; s<n_step; s++) step();
+		quakins::backend::synchronize();
+		auto t2 = std::chrono::steady_clock::now();
+		double ms = std::chrono::duration<double,std::milli>(t2-t1).count();
+		best = trial==0? ms : std::min(best,ms);
+	}
+	time_per_step[config] = best/n_step;
+}
+
+
+// main_1d.cu without the field: the exact solution is f0(x-vt,v)
+void free_stream_1d1v() {
+
+	std::string config = "free_stream_1d1v";
+	constexpr std::size_t nx = 128, nv = 64, nBd = 6, n_step = 200;
+	Real L = 20, dt = L/nx/6/2;
+	quakins::CoordinateSystem<Real,2> coord({nx,nv},{nBd,0},{0,L,-6,6});
+
+	auto f0 = [=](Real x, Real v) {
+		return (1+.1*std::cos(2*M_PI/L*x))*std::exp(-v*v/2)/std::sqrt(2*M_PI);
+	};
+	thrust::device_vector<Real> f_init = sample(coord,
+		[&](std::array<Real,2> z) { return f0(z[0],z[1]); }), f;
+	double m0 = mass(coord,thrust::host_vector<Real>(f_init));
+
+	quakins::fbm::FreeStreamSolver<Real,2,0> solver(coord,dt);
+	timed(config,n_step,[&]{ f = f_init; },[&]{ solver(f.begin()); });
+
+	thrust::host_vector<Real> f_end = f;
+	Real t = n_step*dt;
+	auto exact = sample(coord,
+		[&](std::array<Real,2> z) { return f0(z[0]-z[1]*t,z[1]); });
+	check(config,"relative mass change",std::abs(mass(coord,f_end)/m0-1),1e-5);
+	check(config,"L2 vs exact",relative_L2(coord,f_end,exact),1e-3);
+	reference(config,coord,f_end,1e-4);
+}
+
+// the Strang split Vlasov-Poisson loop of main_1d.cu
+void vlasov_poisson_1d1v() {
+
+	std::string config = "vlasov_poisson_1d1v";
+	constexpr std::size_t nx = 128, nv = 64, nBd = 6, n_step = 200;
+	Real L = 20, dt = L/nx/6/2.3;
+	quakins::CoordinateSystem<Real,2> coord({nx,nv},{nBd,0},{0,L,-6,6});
+
+	thrust::device_vector<Real> f_init = sample(coord,[&](std::array<Real,2> z) {
+		return (1+.1*std::cos(2*M_PI/L*z[0]))
+					*std::exp(-z[1]*z[1]/2)/std::sqrt(2*M_PI); }), f;
+	thrust::device_vector<Real> f_buf(f_init.size());
+	double m0 = mass(coord,thrust::host_vector<Real>(f_init));
+
+	std::size_t nxTot = nx+2*nBd;
+	thrust::device_vector<Real> dens_e(nxTot), dens_i(nxTot,1), charge(nxTot),
+		potential(nxTot), accel(nxTot);
+	quakins::fbm::FreeStreamSolver<Real,2,0> solver_x(coord,dt*.5);
+	quakins::fbm::AccelerationSolver<Real,2,1> solver_v(coord,dt);
+	quakins::FFTPoissonSolver1D<Real,thrust::device_vector>
+		solve_poisson(nx,nBd,L);
+
+	timed(config,n_step,[&]{ f = f_init; },[&]{
+		solver_x.advect_with_density(f.begin(),f_buf.begin(),dens_e.begin());
+		f.swap(f_buf);
+		thrust::transform(dens_i.begin(),dens_i.end(),dens_e.begin(),
+											charge.begin(),thrust::minus<Real>());
+		solve_poisson(charge,potential);
+		quakins::fbm::acceleration_from_potential(potential.begin(),
+			accel.begin(),nx,nBd,coord.dz[0],Real(-1));
+		solver_v(f.begin(),accel.begin());
+		solver_x(f.begin());
+	});
+
+	// f vanishes at the velocity edges, so nothing leaves the grid
+	thrust::host_vector<Real> f_end = f;
+	check(config,"relative mass change",std::abs(mass(coord,f_end)/m0-1),1e-5);
+	reference(config,coord,f_end,1e-4);
+}
+
+// the loop of main_2d.cu: x1 in place, x2 out of place with the density
+void free_stream_2d2v() {
+
+	std::string config = "free_stream_2d2v";
+	constexpr std::size_t nx1 = 32, nx2 = 24, nv1 = 16, nv2 = 14, n_step = 20;
+	Real L1 = 20, L2 = 20, dt = L1/nx1/6/2;
+	quakins::CoordinateSystem<Real,4> coord({nx1,nx2,nv1,nv2},{4,4,0,0},
+		{0,L1,0,L2,-6,6,-6,6});
+
+	auto f0 = [=](Real x1, Real x2, Real v1, Real v2) {
+		return (1+.1*std::cos(2*M_PI/L1*x1))*(1+.1*std::sin(2*M_PI/L2*x2))
+					*std::exp(-(v1*v1+v2*v2)/2)/(2*M_PI);
+	};
+	thrust::device_vector<Real> f_init = sample(coord,[&](std::array<Real,4> z) {
+		return f0(z[0],z[1],z[2],z[3]); }), f;
+	thrust::device_vector<Real> f_buf(f_init.size()), 
+		dens(coord.nzTot[0]*coord.nzTot[1]);
+	double m0 = mass(coord,thrust::host_vector<Real>(f_init));
+
+	quakins::fbm::FreeStreamSolver<Real,4,0> solver_x1(coord,dt);
+	quakins::fbm::FreeStreamSolver<Real,4,1> solver_x2(coord,dt);
+
+	timed(config,n_step,[&]{ f = f_init; },[&]{
+		solver_x1(f.begin());
+		solver_x2.advect_with_density(f.begin(),f_buf.begin(),dens.begin());
+		f.swap(f_buf);
+	});
+
+	thrust::host_vector<Real> f_end = f;
+	Real t = n_step*dt;
+	auto exact = sample(coord,[&](std::array<Real,4> z) {
+		return f0(z[0]-z[2]*t,z[1]-z[3]*t,z[2],z[3]); });
+	check(config,"relative mass change",std::abs(mass(coord,f_end)/m0-1),1e-5);
+	check(config,"L2 vs exact",relative_L2(coord,f_end,exact),2e-3);
+	reference(config,coord,f_end,1e-4);
+}
+
+
+int main(int argc, char* argv[]) {
+
+	int arg = 1;
+	if (argc>arg && std::string(argv[arg])=="record") { record = true; arg++; }
+	else if (argc>arg && std::string(argv[arg])=="baseline") { 
+		record = baseline_only = true; arg++; 
+	}
+	if (argc>arg && std::string(argv[arg])=="--allow-missing") {
+		allow_missing = true; arg++;
+	}
+	if (argc>arg) dir = argv[arg++];
+	if (argc>arg) time_tol = std::stod(argv[arg++]);
+
+	free_stream_1d1v();
+	vlasov_poisson_1d1v();
+	free_stream_2d2v();
+
+	if (record) {
+		std::ofstream os(baseline_path());
+		os << "config,ms_per_step\n";
+		for (auto& [config,ms] : time_per_step) os << config << "," << ms << "\n";
+		if (!os) { std::cerr << "cannot write " << dir << std::endl; return 1; }
+		std::cout << "recorded into " << dir << std::endl;
+	}
+
+	auto baseline = read_baseline();
+	for (auto& [config,ms] : time_per_step) {
+		if (record) continue;
+		if (baseline.count(config)==0) 
+			missing(config,"time/step","no "+baseline_path(),false);
+		else check(config,"time/step over baseline",
+							 ms/baseline[config],1+time_tol);
+	}
+
+	bool pass = true;
+	std::cout << std::left << std::setw(22) << "config" << std::setw(26) << "check"
+						<< std::setw(14) << "value" << std::setw(12) << "limit"
+						<< "result" << std::endl;
+	for (auto& c : checks) {
+		std::cout << std::left << std::setw(22) << c.config << std::setw(26) << c.name
+							<< std::setw(14) << c.value << std::setw(12) << c.limit
+							<< c.result << std::endl;
+		pass = pass && !failed(c);
+	}
+	for (auto& [config,ms] : time_per_step)
+		std::cout << config << ": " << ms << " ms/step" << std::endl;
+	std::cout << (pass? "PASS":"FAIL") << std::endl;
+	return pass? 0 : 1;
+}
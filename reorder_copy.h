@@ -3,35 +3,55 @@
 
 #include <thrust/iterator/permutation_iterator.h>
 #include <thrust/scan.h>
-#include <thrust/async/copy.h>
+#ifndef QUAKINS_HOST
+#include <thrust/system/cuda/execution_policy.h>
+#endif
 #include <thrust/inner_product.h>
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <limits>
+#include <mutex>
+#include <thread>
+#include <vector>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "Backend.hpp"
 #include "WignerFunction.hpp"
 
 
 namespace quakins {
 	namespace piecewise_reorder_copy {
 
+#ifdef QUAKINS_HOST
+		// no streams on the host backend, the pieces run on a worker thread
+		using stream_type = int;
+#else
+		using stream_type = cudaStream_t;
+#endif
+
 		template<std::size_t dim>
 		std::size_t idxM2S(std::array<std::size_t,dim> idx_m,
 								 		std::array<std::size_t,dim> N) {
-			std::array<std::size_t,dim> shift;
-			thrust::exclusive_scan(N.begin(),N.end(),shift.begin(),1,
-														thrust::multiplies<std::size_t>());
-
-			return thrust::inner_product(idx_m.begin(),idx_m.end(),
-											shift.begin(),0);
+			std::size_t idx_s = 0, shift = 1;
+			for (std::size_t i=0; i<dim; i++) {
+				idx_s += idx_m[i]*shift;
+				shift *= N[i];
+			}
+			return idx_s;
 		}
 
 		template<std::size_t dim>
 		std::array<std::size_t,dim> idxS2M(const std::size_t &idx_s,
 												const std::array<std::size_t,dim>& N) {
 			std::array<std::size_t,dim> idx_m;
+			std::size_t idvd = 1;
 			for (std::size_t i=0; i<dim; i++) {
-				std::size_t imod = thrust::reduce(N.begin(),N.begin()+i+1,
-															1, thrust::multiplies<std::size_t>());
-				std::size_t idvd = thrust::reduce(N.begin(),N.begin()+i,
-															1, thrust::multiplies<std::size_t>());
-				idx_m[i] = (idx_s%imod) / idvd;
+				idx_m[i] = idx_s/idvd%N[i];
+				idvd *= N[i];
 			}
 			return idx_m;
 		}
@@ -73,6 +93,19 @@ namespace quakins {
 		};
 
 
+		/**
+		 *  The permutation of order, in n_piece consecutive pieces of the 
+		 *  output, each of which can be copied on its own: execute(i) starts
+		 *  piece i, on streams[i] on the device and on the plan's one worker
+		 *  thread on the host, which does the pieces in the order they are
+		 *  started, one at a time; wait(i) returns once it is there.
+		 *  The pieces are multiples of align elements, the last one is shorter.
+		 *
+		 *  For the pieces to overlap with work on the default stream the
+		 *  streams have to be non-blocking ones, as those of stream_set, and 
+		 *  they do not wait for the default stream either: synchronize before
+		 *  the first piece if the input was just written there.
+		 */
 		template <template<typename...> typename idx_container,
 							typename idx_type,
 						 	std::size_t dim,
@@ -82,49 +115,235 @@ namespace quakins {
 						 >
 		class plan {
 		
-			cudaStream_t *streams;
+			stream_type *streams;
 			idx_container<idx_type> idx_permu; // permutation index
 			std::array<std::size_t,dim> n_dim, n_dim_new;
 			std::array<std::size_t,dim> order;
 
-			std::size_t n_piece, n_stride;
+			std::size_t n_piece, n_stride, n_tot;
 
 			inputItor  inBegin;
 			outputItor outBegin;
+
+#ifdef QUAKINS_HOST
+			// one worker copies the pieces in the order they are started
+			std::vector<char> done;
+			std::deque<std::size_t> queue;
+			std::mutex mtx;
+			std::condition_variable cv;
+			bool stop = false;
+			int copy_threads = 0; // of the worker, 0 for the default
+			std::thread worker;
+
+			void work() {
+				std::unique_lock lock(mtx);
+				while (true) {
+					cv.wait(lock,[this]{ return stop || !queue.empty(); });
+					if (queue.empty()) return;
+					std::size_t i = queue.front(); queue.pop_front();
+#ifdef _OPENMP
+					if (copy_threads>0) omp_set_num_threads(copy_threads);
+#endif
+					lock.unlock();
+					copy(i);
+					lock.lock();
+					done[i] = 1;
+					cv.notify_all();
+				}
+			}
+#else
+			std::vector<cudaEvent_t> done;
+#endif
+
+			void copy(std::size_t i) {
+				auto permutationItor = thrust::make_permutation_iterator(
+											inBegin,idx_permu.begin());
+#ifdef QUAKINS_HOST
+				thrust::copy(permutationItor+begin(i), 
+										permutationItor+end(i), outBegin+begin(i));
+#else
+				thrust::copy(thrust::cuda::par_nosync.on(streams[i]),
+										permutationItor+begin(i), 
+										permutationItor+end(i), outBegin+begin(i));
+#endif
+			}
+
 		public:
-			plan(cudaStream_t *streams, std::size_t n_piece,
+			plan(stream_type *streams, std::size_t n_piece,
 					std::array<std::size_t,dim> n_dim,
 					std::array<std::size_t,dim> order,
-					inputItor in, outputItor out)
-		 		: streams(streams), n_piece(n_piece), 
-				  n_dim(n_dim), order(order), inBegin(in), outBegin(out)	{
+					inputItor in, outputItor out, std::size_t align = 1)
+		 		: streams(streams), n_dim(n_dim), order(order), n_piece(n_piece), 
+				  inBegin(in), outBegin(out), done(n_piece)	{
 
-				auto n_tot = thrust::reduce(n_dim.begin(),n_dim.end(),1,
+				n_tot = thrust::reduce(n_dim.begin(),n_dim.end(),std::size_t(1),
 									thrust::multiplies<std::size_t>());
-				n_stride = n_tot / n_piece;
-				std::cout << n_stride << std::endl;
+				// idx_type has to hold every index of the output
+				assert(n_tot-1<=std::numeric_limits<idx_type>::max());
+				// rounded up, so that no element is left out
+				n_stride = (n_tot+n_piece-1)/n_piece;
+				n_stride = (n_stride+align-1)/align*align;
 				cal_permutation_index<dim, piter_on_origin> op(order,n_dim);
 
 				idx_permu.resize(n_tot);
-				thrust::counting_iterator<int> iter(0);
+				thrust::counting_iterator<std::size_t> iter(0);
 				thrust::transform(iter,iter+n_tot,idx_permu.begin(),op);
 
+#ifdef QUAKINS_HOST
+				std::fill(done.begin(),done.end(),1); // none started
+				worker = std::thread([this]{ work(); });
+#else
+				for (auto& e : done) cudaEventCreateWithFlags(&e,cudaEventDisableTiming);
+#endif
 			}
-				
-			void execute(std::size_t i) {
-				auto permutationItor = thrust::make_permutation_iterator(
-											inBegin,idx_permu.begin());
+			plan(const plan&) = delete;
+			plan& operator=(const plan&) = delete;
+
+			~plan() {
+				wait();
+#ifdef QUAKINS_HOST
+				{ std::lock_guard lock(mtx); stop = true; }
+				cv.notify_all();
+				worker.join();
+#else
+				for (auto& e : done) cudaEventDestroy(e);
+#endif
+			}
+
+			// the other arrays, of the same shape
+			void bind(inputItor in, outputItor out) { inBegin = in; outBegin = out; }
+
+			std::size_t pieces() const { return n_piece; }
+
+			// the elements [begin(i),end(i)) of the output are piece i
+			std::size_t begin(std::size_t i) const { return std::min(i*n_stride,n_tot); }
+			std::size_t end(std::size_t i) const { return std::min((i+1)*n_stride,n_tot); }
 
-				thrust::async::copy(thrust::cuda::par.on(streams[i]),
-										permutationItor+i*n_stride, 
-										permutationItor+(i+1)*n_stride, outBegin);
+			// the OpenMP threads the worker copies with, 0 for the default;
+			// the host has no streams to keep the two sides apart
+			void set_copy_threads(int n) {
+#ifdef QUAKINS_HOST
+				std::lock_guard lock(mtx);
+				copy_threads = n;
+#endif
+			}
 
+			void execute(std::size_t i) {
+#ifdef QUAKINS_HOST
+				{ std::lock_guard lock(mtx); done[i] = 0; queue.push_back(i); }
+				cv.notify_all();
+#else
+				copy(i);
+				cudaEventRecord(done[i],streams[i]);
+#endif
 			}
 
+			void wait(std::size_t i) {
+#ifdef QUAKINS_HOST
+				std::unique_lock lock(mtx);
+				cv.wait(lock,[this,i]{ return done[i]!=0; });
+#else
+				cudaEventSynchronize(done[i]);
+#endif
+			}
 
+			// all pieces
+			void wait() { for (std::size_t i=0; i<n_piece; i++) wait(i); }
+
+			// all pieces, one after the other
+			void operator()() {
+				for (std::size_t i=0; i<n_piece; i++) execute(i);
+				wait();
+			}
 
 		}; 
 
+		/// n streams that do not wait for the default one
+		class stream_set {
+			std::vector<stream_type> streams;
+		public:
+			stream_set(std::size_t n) : streams(n) {
+#ifndef QUAKINS_HOST
+				for (auto& s : streams) cudaStreamCreateWithFlags(&s,cudaStreamNonBlocking);
+#endif
+			}
+			stream_set(const stream_set&) = delete;
+			stream_set& operator=(const stream_set&) = delete;
+			~stream_set() {
+#ifndef QUAKINS_HOST
+				for (auto& s : streams) cudaStreamDestroy(s);
+#endif
+			}
+			stream_type* data() { return streams.data(); }
+		};
+
+		/**
+		 *  compute(b,e) on every piece [b,e) of the output of p as soon as it
+		 *  has been copied: piece i+1 is copied while compute runs on piece i,
+		 *  so the transpose is hidden behind the compute, or the other way
+		 *  around, instead of both taking their time one after the other.
+		 *  compute issues its work to the default stream. On the host the 
+		 *  OpenMP threads are split between the copies and compute, so that
+		 *  the two do not take all of them each.
+		 */
+		template <typename plan_type, typename func_type>
+		void pipeline(plan_type& p, func_type compute) {
+			backend::synchronize(); // the input
+#if defined(QUAKINS_HOST) && defined(_OPENMP)
+			int n_thread = omp_get_max_threads(), n_copy = std::max(1,n_thread/2);
+			p.set_copy_threads(n_copy);
+			omp_set_num_threads(std::max(1,n_thread-n_copy));
+#endif
+			p.execute(0);
+			for (std::size_t i=0; i<p.pieces(); i++) {
+				if (i+1<p.pieces()) p.execute(i+1);
+				p.wait(i);
+				compute(p.begin(i),p.end(i));
+			}
+			backend::synchronize();
+#if defined(QUAKINS_HOST) && defined(_OPENMP)
+			p.set_copy_threads(0);
+			omp_set_num_threads(n_thread);
+#endif
+		}
+
+		// wall times of the transpose alone, of the compute alone, of both
+		// pipelined and of the same work without the pipeline, in ms
+		struct overlap {
+			double transpose, compute, pipelined, serial;
+
+			// > 1 if the pipeline is faster than the work without it
+			double speedup() const { return serial/pipelined; }
+
+			// the share of the shorter one hidden behind the other
+			double hidden() const {
+				return (transpose+compute-pipelined)/std::min(transpose,compute);
+			}
+		};
+
+		// pipeline() with the times it saves, against serial(), the same work
+		// without the pipeline, such as the whole transpose and then compute;
+		// the last run leaves the output of pipeline()
+		template <typename plan_type, typename func_type, typename serial_type>
+		overlap measure_overlap(plan_type& p, func_type compute, serial_type serial) {
+			using clock = std::chrono::steady_clock;
+			auto ms = [](auto&& run) {
+				backend::synchronize();
+				auto t0 = clock::now();
+				run();
+				backend::synchronize();
+				return std::chrono::duration<double,std::milli>(clock::now()-t0).count();
+			};
+			overlap o;
+			o.transpose = ms([&]{ p(); });
+			o.compute = ms([&]{
+				for (std::size_t i=0; i<p.pieces(); i++) compute(p.begin(i),p.end(i));
+			});
+			o.serial = ms(serial);
+			o.pipelined = ms([&]{ pipeline(p,compute); });
+			return o;
+		}
+
 	} // namespace piecewise_reorder_copy
 
 } // namespace quakins 
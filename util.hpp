@@ -117,25 +117,26 @@ void sparse_print(std::ofstream& os, Iterator itor_begin,
 
 // multi-array indices operations
 template<std::size_t dim>
+__host__ __device__
 std::size_t idxM2S(std::array<std::size_t,dim> idx_m,
 							 		std::array<std::size_t,dim> N) {
-	std::array<std::size_t,dim> shift;
-	thrust::exclusive_scan(N.begin(),N.end(),shift.begin(),1,
-												thrust::multiplies<std::size_t>());
-	return thrust::inner_product(idx_m.begin(),idx_m.end(),
-									shift.begin(),0);
+	std::size_t idx_s = 0, shift = 1;
+	for (std::size_t i=0; i<dim; i++) {
+		idx_s += idx_m[i]*shift;
+		shift *= N[i];
+	}
+	return idx_s;
 }
 
 template<std::size_t dim>
+__host__ __device__
 std::array<std::size_t,dim> idxS2M(const std::size_t &idx_s,
 									const std::array<std::size_t,dim>& N) {
 	std::array<std::size_t,dim> idx_m;
+	std::size_t idvd = 1;
 	for (std::size_t i=0; i<dim; i++) {
-		std::size_t imod = thrust::reduce(N.begin(),N.begin()+i+1,
-													1, thrust::multiplies<std::size_t>());
-		std::size_t idvd = thrust::reduce(N.begin(),N.begin()+i,
-													1, thrust::multiplies<std::size_t>());
-		idx_m[i] = (idx_s%imod) / idvd;
+		idx_m[i] = idx_s/idvd%N[i];
+		idvd *= N[i];
 	}
 	return idx_m;
 }